@@ -0,0 +1,76 @@
+#include "affinity.hpp"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+/**
+ * @brief Parse a kernel CPU or node list, such as "0-3,8-11"
+ */
+static std::vector<int> parseList(const char *list)
+{
+  std::vector<int> cpus;
+  const char *p = list;
+  while (*p)
+  {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p)
+      break;
+    long last = first;
+    if (*end == '-')
+    {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+    }
+    for (long cpu = first; cpu <= last; cpu++)
+      cpus.push_back((int)cpu);
+    if (*end != ',')
+      break;
+    p = end + 1;
+  }
+  return cpus;
+}
+
+/**
+ * @brief Read a kernel CPU or node list from a sysfs file
+ */
+static std::vector<int> readList(const std::string &path)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f)
+    return std::vector<int>();
+  char list[4096] = "";
+  bool read = fgets(list, sizeof(list), f) != NULL;
+  fclose(f);
+  return read ? parseList(list) : std::vector<int>();
+}
+
+std::vector<std::vector<int>> numaNodeCpus()
+{
+  std::vector<std::vector<int>> nodes;
+  for (int node : readList("/sys/devices/system/node/online"))
+  {
+    std::vector<int> cpus = readList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!cpus.empty()) // memory-only nodes have no CPU
+      nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+bool pinToCpus(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus)
+  {
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  return CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
@@ -0,0 +1,29 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#include <vector>
+
+/**
+ * @brief CPUs of every NUMA node of the machine
+ *
+ * @return The CPU ids of each node, in node order, read from
+ * /sys/devices/system/node; empty where the machine does not report its
+ * nodes
+ */
+std::vector<std::vector<int>> numaNodeCpus();
+
+/**
+ * @brief Restrict the calling process to a set of CPUs
+ *
+ * @param cpus The CPU ids, such as those of a NUMA node
+ *
+ * @return False if the process could not be pinned, or pinning is not
+ * supported on this system
+ *
+ * The kernel allocates the memory a process touches first on the node it
+ * runs on, so a process pinned to the CPUs of one node keeps its images
+ * and buffers local to that node.
+ */
+bool pinToCpus(const std::vector<int> &cpus);
+
+#endif
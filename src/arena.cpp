@@ -0,0 +1,33 @@
+#include "arena.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+
+void Arena::reserve(size_t bytes, bool huge_pages)
+{
+  used = 0;
+  if (bytes <= cap)
+    return;
+  release();
+
+  size_t page = huge_pages ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+  size_t size = (bytes + page - 1) / page * page;
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+  if (huge_pages)
+    madvise(p, size, MADV_HUGEPAGE); // a hint only, regular pages otherwise
+#endif
+  base = (uint8_t *)p;
+  cap = size;
+}
+
+void Arena::release()
+{
+  if (base)
+    munmap(base, cap);
+  base = NULL;
+  cap = 0;
+  used = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Bump allocator for the working memory of a run
+ *
+ * Reserves one anonymous memory mapping and hands out aligned slices of it,
+ * so that the buffers of a run cost a single system allocation instead of
+ * one heap allocation each. Slices are never freed one by one: `reset()`
+ * makes the whole arena available again in O(1). Slices are not initialized.
+ */
+class Arena
+{
+public:
+  // alignment of every slice, a cache line
+  static constexpr size_t ALIGNMENT = 64;
+
+  // size of a transparent huge page on x86-64 and arm64 with 4 KiB pages
+  static constexpr size_t HUGE_PAGE = 2 << 20;
+
+  Arena() {}
+
+  ~Arena()
+  {
+    release();
+  }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /**
+   * @brief Make room for a number of bytes, resetting the arena
+   *
+   * @param bytes Total size of the slices that will be allocated, alignment included
+   * @param huge_pages Whether to ask the kernel to back the arena with
+   * transparent huge pages, where supported
+   *
+   * Keeps the current mapping if it is already large enough, otherwise
+   * replaces it, which invalidates every slice. Throws std::bad_alloc if the
+   * memory cannot be mapped.
+   */
+  void reserve(size_t bytes, bool huge_pages = false);
+
+  /**
+   * @brief Allocate an aligned slice of n elements
+   *
+   * @return The slice, or NULL if the arena is too small
+   */
+  template <typename T>
+  T *alloc(size_t n)
+  {
+    size_t start = (used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (start + n * sizeof(T) > cap)
+      return NULL;
+    used = start + n * sizeof(T);
+    return (T *)(base + start);
+  }
+
+  /**
+   * @brief Bytes needed by a slice of n elements, alignment included
+   */
+  template <typename T>
+  static size_t footprint(size_t n)
+  {
+    return (n * sizeof(T) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
+
+  /**
+   * @brief Make the whole arena available again, invalidating every slice
+   */
+  void reset()
+  {
+    used = 0;
+  }
+
+  /**
+   * @brief Size of the mapping in bytes
+   */
+  size_t capacity() const
+  {
+    return cap;
+  }
+
+  /**
+   * @brief Bytes allocated since the last reset
+   */
+  size_t size() const
+  {
+    return used;
+  }
+
+  /**
+   * @brief Unmap the arena
+   */
+  void release();
+
+private:
+  uint8_t *base = NULL;
+  size_t cap = 0;
+  size_t used = 0;
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include "bounded_queue.hpp"
+
+namespace fs = std::filesystem;
+
+// an image and its path, passed from one pipeline stage to the next
+struct BatchItem
+{
+  std::string path;
+  cv::Mat mat;
+};
+
+/**
+ * @brief Whether a file name has the extension of an image format
+ */
+static bool isImageFile(const fs::path &path)
+{
+  static const char *extensions[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff",
+                                     ".webp", ".ppm", ".pgm", ".pnm"};
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  for (const char *e : extensions)
+  {
+    if (ext == e)
+      return true;
+  }
+  return false;
+}
+
+std::vector<std::string> listImages(const std::string &source)
+{
+  std::vector<std::string> paths;
+  std::error_code ec;
+  if (fs::is_directory(source, ec))
+  {
+    for (const auto &entry : fs::directory_iterator(source, ec))
+    {
+      if (entry.is_regular_file(ec) && isImageFile(entry.path()))
+        paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  std::ifstream list(source);
+  std::string line;
+  while (std::getline(list, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (!line.empty())
+      paths.push_back(line);
+  }
+  return paths;
+}
+
+std::string outputPath(const std::string &input, const std::string &out_dir, const std::string &ext)
+{
+  return (fs::path(out_dir) / (fs::path(input).stem().string() + ext)).string();
+}
+
+int runBatch(const std::vector<std::string> &inputs,
+             const std::function<cv::Mat(const std::string &, const cv::Mat &)> &segment,
+             const std::function<bool(const std::string &, const cv::Mat &)> &encode,
+             size_t queue_size)
+{
+  size_t next = 0;
+  return runBatch(
+      [&](std::string &path)
+      {
+        if (next == inputs.size())
+          return false;
+        path = inputs[next++];
+        return true;
+      },
+      segment, encode, [](const std::string &, bool) {}, queue_size);
+}
+
+int runBatch(const std::function<bool(std::string &)> &next,
+             const std::function<cv::Mat(const std::string &, const cv::Mat &)> &segment,
+             const std::function<bool(const std::string &, const cv::Mat &)> &encode,
+             const std::function<void(const std::string &, bool)> &finished, size_t queue_size)
+{
+  BoundedQueue<BatchItem> decoded(queue_size), segmented(queue_size);
+  std::atomic<int> failures(0);
+
+  std::thread decoder([&]
+  {
+    std::string path;
+    try
+    {
+      while (next(path))
+      {
+        cv::Mat im;
+        try
+        {
+          im = cv::imread(path, cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+        }
+        catch (const std::exception &e)
+        {
+          std::cerr << "Could not read image " << path << ": " << e.what() << std::endl;
+          failures++;
+          finished(path, false);
+          continue;
+        }
+        if (im.empty())
+        {
+          std::cerr << "Could not read image " << path << std::endl;
+          failures++;
+          finished(path, false);
+          continue;
+        }
+        decoded.push(BatchItem{path, im});
+      }
+    }
+    catch (const std::exception &e)
+    {
+      // the source of paths failed, so stop reading and let the images already queued drain
+      std::cerr << "Could not get the next image: " << e.what() << std::endl;
+      failures++;
+    }
+    decoded.close();
+  });
+
+  std::thread encoder([&]
+  {
+    BatchItem item;
+    while (segmented.pop(item))
+    {
+      bool written;
+      try
+      {
+        written = encode(item.path, item.mat);
+      }
+      catch (const std::exception &)
+      {
+        written = false;
+      }
+      if (!written)
+      {
+        std::cerr << "Could not write the result of " << item.path << std::endl;
+        failures++;
+      }
+      finished(item.path, written);
+    }
+  });
+
+  BatchItem item;
+  while (decoded.pop(item))
+  {
+    try
+    {
+      item.mat = segment(item.path, item.mat);
+      segmented.push(std::move(item));
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Could not segment " << item.path << ": " << e.what() << std::endl;
+      failures++;
+      finished(item.path, false);
+    }
+  }
+  segmented.close();
+
+  decoder.join();
+  encoder.join();
+  return failures;
+}
@@ -0,0 +1,74 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief List the images of a batch
+ *
+ * @param source A directory, whose image files are listed in name order, or
+ * a text file listing one image path per line
+ *
+ * @return The image paths, empty if the source cannot be read
+ */
+std::vector<std::string> listImages(const std::string &source);
+
+/**
+ * @brief Output path of an image of a batch
+ *
+ * @param input Path of the input image
+ * @param out_dir Output directory
+ * @param ext Extension of the output file, with the dot
+ *
+ * @return out_dir/<input file name without extension><ext>
+ */
+std::string outputPath(const std::string &input, const std::string &out_dir, const std::string &ext);
+
+/**
+ * @brief Segment a batch of images through a decode, segment, encode pipeline
+ *
+ * @param inputs Paths of the images
+ * @param segment Computes the result of a decoded image, given its input path
+ * @param encode Writes the result of an image, given its input path; returns false on failure
+ * @param queue_size Capacity of the queues between stages
+ *
+ * @return The number of images that failed to decode, segment or encode
+ *
+ * Decoding, segmentation and encoding run concurrently on three threads,
+ * connected by bounded queues, so that image I/O overlaps with compute and
+ * at most `queue_size` images wait between two stages. Images are decoded
+ * at their own depth and channel count, so grayscale and 16-bit images reach
+ * `segment` as they are stored. `segment` is always
+ * called from the calling thread, one image at a time. Nothing is displayed.
+ */
+int runBatch(const std::vector<std::string> &inputs,
+             const std::function<cv::Mat(const std::string &, const cv::Mat &)> &segment,
+             const std::function<bool(const std::string &, const cv::Mat &)> &encode,
+             size_t queue_size = 4);
+
+/**
+ * @brief Segment images as they are handed out, through the same pipeline
+ *
+ * @param next Gives the path of the next image; returns false when there is none left
+ * @param segment See above
+ * @param encode See above
+ * @param finished Called once per image given by `next`, with whether it was
+ * decoded, segmented and encoded, from the thread of the stage it ended in
+ * @param queue_size See above
+ *
+ * @return The number of images that failed
+ *
+ * `next` is called from the decoding thread, as the pipeline needs images,
+ * so the images can be taken from a queue shared with other processes.
+ * An exception thrown by `next` counts as one failure and ends the batch
+ * once the images already handed out are done.
+ */
+int runBatch(const std::function<bool(std::string &)> &next,
+             const std::function<cv::Mat(const std::string &, const cv::Mat &)> &segment,
+             const std::function<bool(const std::string &, const cv::Mat &)> &encode,
+             const std::function<void(const std::string &, bool)> &finished, size_t queue_size = 4);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief Blocking FIFO queue with a fixed capacity, between pipeline stages
+ *
+ * `push()` blocks while the queue is full, `pop()` blocks while it is empty.
+ * The producer calls `close()` once it is done; consumers then drain the
+ * remaining items and `pop()` returns false.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+  /**
+   * @brief Add an item, waiting for room if the queue is full
+   */
+  void push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [&] { return items.size() < capacity; });
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+  }
+
+  /**
+   * @brief Take the oldest item, waiting for one if the queue is empty
+   *
+   * @param item Receives the item
+   *
+   * @return False once the queue is closed and empty
+   */
+  bool pop(T &item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [&] { return !items.empty() || closed; });
+    if (items.empty())
+      return false;
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  /**
+   * @brief Signal that no more items will be pushed
+   */
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+  }
+
+private:
+  size_t capacity;
+  bool closed = false;
+  std::deque<T> items;
+  std::mutex mutex;
+  std::condition_variable notEmpty, notFull;
+};
+
+#endif
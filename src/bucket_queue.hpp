@@ -0,0 +1,95 @@
+#ifndef BUCKET_QUEUE_HPP
+#define BUCKET_QUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief Priority queue of pixels with small integer priorities
+ *
+ * A bucketed (Dial) queue: one FIFO bucket per priority in [0, levels), and a
+ * cursor on the lowest bucket that may be non-empty. Push and pop are O(1),
+ * plus the cursor moving up over empty buckets, which is O(levels) over a
+ * whole run when priorities mostly increase. Pushing below the cursor moves
+ * it back. Entries of equal priority come out in push order, so runs are
+ * deterministic.
+ *
+ * Each entry carries a pixel index and a tag, such as the region that
+ * queued the pixel.
+ */
+class BucketQueue
+{
+public:
+  // an entry of the queue
+  struct Entry
+  {
+    uint32_t idx;      // linear index of the pixel
+    uint32_t tag;      // caller data, such as a region number
+    uint32_t priority; // bucket of the entry
+  };
+
+  /**
+   * @brief Construct a queue for priorities in [0, levels)
+   */
+  explicit BucketQueue(int levels) : buckets(levels), heads(levels, 0) {}
+
+  /**
+   * @brief Add an entry
+   *
+   * @param priority Priority of the entry, clamped to the last bucket
+   * @param idx Linear index of the pixel
+   * @param tag Caller data
+   */
+  void push(uint32_t priority, uint32_t idx, uint32_t tag)
+  {
+    if (priority >= buckets.size())
+      priority = (uint32_t)buckets.size() - 1;
+    buckets[priority].push_back(Entry{idx, tag, priority});
+    if (priority < cursor)
+      cursor = priority;
+    count++;
+  }
+
+  /**
+   * @brief Take the oldest entry of the lowest priority; the queue must not be empty
+   */
+  Entry pop()
+  {
+    while (heads[cursor] == buckets[cursor].size())
+      cursor++;
+    std::vector<Entry> &bucket = buckets[cursor];
+    Entry e = bucket[heads[cursor]++];
+    if (heads[cursor] == bucket.size()) // drained, reuse its storage
+    {
+      bucket.clear();
+      heads[cursor] = 0;
+    }
+    count--;
+    return e;
+  }
+
+  /**
+   * @brief Whether the queue holds no entry
+   */
+  bool empty() const
+  {
+    return count == 0;
+  }
+
+  /**
+   * @brief Number of entries
+   */
+  size_t size() const
+  {
+    return count;
+  }
+
+private:
+  std::vector<std::vector<Entry>> buckets;
+  std::vector<size_t> heads; // index of the oldest entry of each bucket
+  uint32_t cursor = 0;       // no entry has a lower priority
+  size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef COLOR_DISTANCE_HPP
+#define COLOR_DISTANCE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// distance between two pixels compared against the threshold
+enum ColorMetric
+{
+  METRIC_L2,       // Euclidean distance, compared squared
+  METRIC_L1,       // sum of the absolute channel differences
+  METRIC_CHEBYSHEV // largest absolute channel difference
+};
+
+/**
+ * @brief Squared Euclidean distance between two 3-channel 8-bit pixels
+ *
+ * @param a The first color pixel
+ * @param b The second color pixel
+ *
+ * @return (a_0 - b_0)^2 + (a_1 - b_1)^2 + (a_2 - b_2)^2
+ *
+ * Integer arithmetic only; compare the result against `squaredThreshold()`
+ * instead of taking the square root.
+ */
+inline int distance2(const cv::Vec3b &a, const cv::Vec3b &b)
+{
+  int d0 = a[0] - b[0];
+  int d1 = a[1] - b[1];
+  int d2 = a[2] - b[2];
+  return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+/**
+ * @brief Integer bound equivalent to a Euclidean distance threshold
+ *
+ * @param thresh The Euclidean distance threshold
+ *
+ * @return The smallest integer t2 such that, for any integer squared distance
+ * d2, `d2 < t2` holds exactly when `sqrt(d2) < thresh`.
+ */
+inline int squaredThreshold(double thresh)
+{
+  if (thresh <= 0)
+    return 0;
+  double t2 = std::ceil(thresh * thresh);
+  return t2 > INT_MAX ? INT_MAX : (int)t2;
+}
+
+/**
+ * @brief Type holding the distance between two pixels of channel type T
+ *
+ * Exact for 8-bit pixels in int and 16-bit pixels in int64_t, whatever the
+ * metric and up to 4 channels.
+ */
+template <typename T>
+struct DistanceType
+{
+  typedef int type;
+};
+
+template <>
+struct DistanceType<ushort>
+{
+  typedef int64_t type;
+};
+
+template <>
+struct DistanceType<float>
+{
+  typedef float type;
+};
+
+/**
+ * @brief Distance between two pixels of CN channels of type T
+ *
+ * @param a The first pixel
+ * @param b The second pixel
+ *
+ * @return The distance of metric M, squared for `METRIC_L2`. The channel loop
+ * has a constant trip count and the metric is a template parameter, so every
+ * instantiation is unrolled and branch-free.
+ */
+template <ColorMetric M, int CN, typename T>
+inline typename DistanceType<T>::type pixelDistance(const T *a, const T *b)
+{
+  typedef typename DistanceType<T>::type D;
+  D d = 0;
+  for (int c = 0; c < CN; c++)
+  {
+    D diff = (D)a[c] - (D)b[c];
+    if (M == METRIC_L2)
+      d += diff * diff;
+    else if (M == METRIC_L1)
+      d += diff < 0 ? -diff : diff;
+    else
+      d = std::max(d, diff < 0 ? -diff : diff);
+  }
+  return d;
+}
+
+/**
+ * @brief Bound of `pixelDistance()` equivalent to a distance threshold
+ *
+ * @param metric The metric
+ * @param thresh The distance threshold
+ *
+ * @return The bound b such that `pixelDistance() < b` holds exactly when the
+ * distance is below `thresh`: see `squaredThreshold()` for `METRIC_L2` on
+ * integer channels, the threshold rounded up for the other metrics, and the
+ * threshold itself, squared for `METRIC_L2`, on float channels.
+ */
+template <typename T>
+inline typename DistanceType<T>::type distanceBound(ColorMetric metric, double thresh)
+{
+  typedef typename DistanceType<T>::type D;
+  if (thresh <= 0)
+    return 0;
+  double t = metric == METRIC_L2 ? thresh * thresh : thresh;
+  if (std::is_floating_point<D>::value)
+    return (D)t;
+  t = std::ceil(t);
+  return t > (double)std::numeric_limits<D>::max() ? std::numeric_limits<D>::max() : (D)t;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "color_space.hpp"
+#include <string.h>
+
+bool colorSpaceFromName(const char *name, ColorSpace &space)
+{
+  if (strcmp(name, "bgr") == 0)
+    space = SPACE_BGR;
+  else if (strcmp(name, "lab8") == 0)
+    space = SPACE_LAB8;
+  else if (strcmp(name, "lab") == 0)
+    space = SPACE_LAB;
+  else
+    return false;
+  return true;
+}
+
+cv::Mat convertColorSpace(const cv::Mat &im, ColorSpace space)
+{
+  if (space == SPACE_BGR)
+    return im;
+  if (im.channels() != 3 && im.channels() != 4)
+    CV_Error(cv::Error::StsUnsupportedFormat, "CIELab needs a BGR or BGRA image");
+
+  cv::Mat bgr = im;
+  if (im.channels() == 4)
+    cv::cvtColor(im, bgr, cv::COLOR_BGRA2BGR);
+
+  // scale of the pixels to [0, 1] for float CIELab, or to [0, 255] for 8-bit CIELab
+  double unit = im.depth() == CV_8U ? 1.0 / 255 : im.depth() == CV_16U ? 1.0 / 65535 : 1.0;
+  cv::Mat scaled, lab;
+  if (space == SPACE_LAB8)
+  {
+    if (im.depth() != CV_8U)
+      bgr.convertTo(scaled, CV_8U, 255 * unit);
+    cv::cvtColor(im.depth() != CV_8U ? scaled : bgr, lab, cv::COLOR_BGR2Lab);
+  }
+  else
+  {
+    if (im.depth() != CV_32F)
+      bgr.convertTo(scaled, CV_32F, unit);
+    cv::cvtColor(im.depth() != CV_32F ? scaled : bgr, lab, cv::COLOR_BGR2Lab);
+  }
+  return lab;
+}
+
+cv::Mat ColorCache::convert(const cv::Mat &im, ColorSpace space, bool *reused)
+{
+  bool same = space == convertedSpace && !converted.empty() && source.data == im.data && source.rows == im.rows &&
+              source.cols == im.cols && source.type() == im.type() && (size_t)source.step == (size_t)im.step;
+  if (reused)
+    *reused = same;
+  if (space == SPACE_BGR)
+    return im;
+  if (!same)
+  {
+    converted = convertColorSpace(im, space);
+    source = im;
+    convertedSpace = space;
+  }
+  return converted;
+}
@@ -0,0 +1,85 @@
+#ifndef COLOR_SPACE_HPP
+#define COLOR_SPACE_HPP
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Color space the pixels are compared in
+ *
+ * Distances in BGR follow the camera, not the eye: thresholds low enough to
+ * keep apart colors that look different split the shades of a single
+ * surface. In CIELab, equal distances are roughly equally visible, so one
+ * threshold fits dark and bright, saturated and gray regions alike.
+ */
+enum ColorSpace
+{
+  SPACE_BGR,  // the pixels as given
+  SPACE_LAB8, // 8-bit CIELab of OpenCV: L * 255 / 100, a + 128, b + 128
+  SPACE_LAB   // float CIELab: L in [0, 100], a and b around 0, Euclidean distances are CIE76 delta E
+};
+
+/**
+ * @brief Color space from its name: "bgr", "lab8" or "lab"
+ *
+ * @return False if the name is unknown
+ */
+bool colorSpaceFromName(const char *name, ColorSpace &space);
+
+/**
+ * @brief Convert an image to a color space
+ *
+ * @param im Image of 3 (BGR) or 4 (BGRA, the alpha is dropped) channels of
+ * CV_8U, CV_16U or CV_32F in [0, 1]; any image for `SPACE_BGR`
+ * @param space The color space
+ *
+ * @return The converted image, CV_8UC3 for `SPACE_LAB8` and CV_32FC3 for
+ * `SPACE_LAB`, or `im` itself, without any copy, for `SPACE_BGR`
+ *
+ * The conversion is a single vectorized `cv::cvtColor` pass, after scaling
+ * the pixels to [0, 1] for float CIELab. 16-bit and float images are reduced
+ * to 8 bits for `SPACE_LAB8`. Throws `cv::Exception` for grayscale images,
+ * which have no color to convert.
+ */
+cv::Mat convertColorSpace(const cv::Mat &im, ColorSpace space);
+
+/**
+ * @brief Converted image of the last image given, kept for the next call
+ *
+ * A threshold sweep segments the same image again and again: the cache
+ * converts it on the first call only, and returns the same converted image
+ * as long as it is given the same image in the same color space. The image
+ * is recognized by its memory, which the cache keeps a reference to, so
+ * that it cannot be freed and reused by another image in between; call
+ * `clear()` after writing new pixels in place, or when the image is a view
+ * of memory the caller reuses.
+ */
+class ColorCache
+{
+public:
+  /**
+   * @brief Convert an image, or return its conversion by the previous call
+   *
+   * @param im The image, see `convertColorSpace()`
+   * @param space The color space
+   * @param reused If not NULL, set to whether the previous conversion was returned
+   *
+   * @return The converted image, valid until the next call
+   */
+  cv::Mat convert(const cv::Mat &im, ColorSpace space, bool *reused = NULL);
+
+  /**
+   * @brief Forget the last conversion
+   */
+  void clear()
+  {
+    source.release();
+    converted.release();
+  }
+
+private:
+  cv::Mat source;    // image converted last
+  cv::Mat converted; // its conversion
+  ColorSpace convertedSpace = SPACE_BGR;
+};
+
+#endif
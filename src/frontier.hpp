@@ -0,0 +1,199 @@
+#ifndef FRONTIER_HPP
+#define FRONTIER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// order in which the pixels of a frontier are visited
+enum FrontierOrder
+{
+  ORDER_LIFO, // depth-first: most recent pixel first
+  ORDER_FIFO  // breadth-first: oldest pixel first
+};
+
+/**
+ * @brief Pixels waiting to be visited while a region grows
+ *
+ * Stores the linear index (x * w + y) of every pixel in a single contiguous
+ * uint32 buffer, used as a stack in LIFO order and as a ring in FIFO order.
+ * Since region growing claims a pixel before pushing it, a frontier never
+ * holds more than h * w pixels: reserving that capacity up front means that
+ * `push()` never reallocates. The buffer still grows if it is ever full. The
+ * buffer is either owned or attached from the caller's memory, such as an
+ * `Arena`.
+ *
+ * The order does not change which pixels are reached, only the order in
+ * which they are visited, and thus how far apart in memory the pixels of the
+ * frontier are.
+ */
+class Frontier
+{
+public:
+  Frontier() {}
+
+  /**
+   * @brief Construct a frontier, see `reserve()`
+   */
+  explicit Frontier(size_t capacity, FrontierOrder order = ORDER_LIFO) : order(order)
+  {
+    reserve(capacity);
+  }
+
+  Frontier(const Frontier &) = delete;
+  Frontier &operator=(const Frontier &) = delete;
+  Frontier(Frontier &&) = default;
+  Frontier &operator=(Frontier &&) = default;
+
+  /**
+   * @brief Make room for a number of pixels, emptying the frontier
+   *
+   * @param capacity Number of pixels, h * w for a whole image
+   *
+   * Keeps the buffer if it is already large enough.
+   */
+  void reserve(size_t capacity)
+  {
+    clear();
+    if (capacity > cap)
+    {
+      owned.resize(capacity);
+      items = owned.data();
+      cap = capacity;
+    }
+  }
+
+  /**
+   * @brief Use the caller's memory as buffer, emptying the frontier
+   *
+   * @param buffer Room for capacity pixels, which must outlive its use here
+   * @param capacity Number of pixels of the buffer
+   */
+  void attach(uint32_t *buffer, size_t capacity)
+  {
+    clear();
+    std::vector<uint32_t>().swap(owned);
+    items = buffer;
+    cap = capacity;
+  }
+
+  /**
+   * @brief Select the visiting order, emptying the frontier
+   */
+  void setOrder(FrontierOrder o)
+  {
+    clear();
+    order = o;
+  }
+
+  /**
+   * @brief The visiting order
+   */
+  FrontierOrder getOrder() const
+  {
+    return order;
+  }
+
+  /**
+   * @brief Add a pixel
+   *
+   * @param idx Linear index of the pixel
+   */
+  void push(uint32_t idx)
+  {
+    if (count == cap)
+      grow();
+    size_t tail = head + count;
+    if (tail >= cap)
+      tail -= cap;
+    items[tail] = idx;
+    count++;
+  }
+
+  /**
+   * @brief Take the next pixel to visit; the frontier must not be empty
+   *
+   * @return The most recent pixel in LIFO order, the oldest in FIFO order
+   */
+  uint32_t pop()
+  {
+    count--;
+    if (order == ORDER_LIFO)
+    {
+      size_t tail = head + count;
+      return items[tail >= cap ? tail - cap : tail];
+    }
+    uint32_t idx = items[head];
+    if (++head == cap)
+      head = 0;
+    return idx;
+  }
+
+  /**
+   * @brief Whether no pixel is waiting
+   */
+  bool empty() const
+  {
+    return count == 0;
+  }
+
+  /**
+   * @brief Number of waiting pixels
+   */
+  size_t size() const
+  {
+    return count;
+  }
+
+  /**
+   * @brief The buffer, room for `capacity()` pixels, when the frontier is not in use
+   */
+  uint32_t *data()
+  {
+    return items;
+  }
+
+  /**
+   * @brief Number of pixels the buffer holds
+   */
+  size_t capacity() const
+  {
+    return cap;
+  }
+
+  /**
+   * @brief Remove every pixel
+   */
+  void clear()
+  {
+    head = 0;
+    count = 0;
+  }
+
+private:
+  /**
+   * @brief Double the buffer, moving the ring to its start
+   */
+  void grow()
+  {
+    std::vector<uint32_t> larger(cap == 0 ? 1024 : 2 * cap);
+    for (size_t i = 0; i < count; i++)
+    {
+      size_t k = head + i;
+      larger[i] = items[k >= cap ? k - cap : k];
+    }
+    owned.swap(larger);
+    items = owned.data();
+    cap = owned.size();
+    head = 0;
+  }
+
+  std::vector<uint32_t> owned; // buffer, unless attached
+  uint32_t *items = NULL;
+  size_t cap = 0;
+  size_t head = 0;  // index of the oldest pixel
+  size_t count = 0; // number of waiting pixels
+  FrontierOrder order = ORDER_LIFO;
+};
+
+#endif
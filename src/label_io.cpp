@@ -0,0 +1,266 @@
+#include "label_io.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+// header of the raw and RLE label files
+struct LabelFileHeader
+{
+  char magic[4];
+  uint32_t h, w;
+  uint32_t reserved; // 0, pads the header to 16 bytes
+};
+
+static const char RAW_MAGIC[4] = {'R', 'G', 'L', 'B'};
+static const char RLE_MAGIC[4] = {'R', 'G', 'L', 'R'};
+
+// PNG16 value of the rejected pixels
+static const uint16_t PNG_REJECTED = UINT16_MAX;
+
+/**
+ * @brief Lowercase extension of a path, with the dot, or "" if it has none
+ */
+static std::string extensionOf(const std::string &path)
+{
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return "";
+  std::string ext = path.substr(dot);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return ext;
+}
+
+bool labelFormatFromPath(const std::string &path, LabelFormat &format)
+{
+  std::string ext = extensionOf(path);
+  return ext.size() > 1 && labelFormatFromName(ext.c_str() + 1, format);
+}
+
+bool labelFormatFromName(const char *name, LabelFormat &format)
+{
+  if (strcmp(name, "raw") == 0)
+    format = LABELS_RAW;
+  else if (strcmp(name, "png") == 0)
+    format = LABELS_PNG16;
+  else if (strcmp(name, "rle") == 0)
+    format = LABELS_RLE;
+  else
+    return false;
+  return true;
+}
+
+const char *labelExtension(LabelFormat format)
+{
+  switch (format)
+  {
+  case LABELS_RAW:
+    return ".raw";
+  case LABELS_PNG16:
+    return ".png";
+  default:
+    return ".rle";
+  }
+}
+
+cv::Mat exportLabels(const LabelMap &labels)
+{
+  const cv::Mat &stored = labels.mat();
+  cv::Mat out(stored.rows, stored.cols, CV_32S);
+  uint32_t *dst = (uint32_t *)out.data;
+  const uint32_t marker = labels.maxLabel();
+  const int n = stored.rows * stored.cols;
+  for (int idx = 0; idx < n; idx++)
+  {
+    uint32_t l = labels.get(idx);
+    dst[idx] = l == marker ? LABEL_REJECTED : l;
+  }
+  return out;
+}
+
+/**
+ * @brief Write a 16-byte header, see `writeLabels()`
+ */
+static bool writeHeader(FILE *f, const char magic[4], int h, int w)
+{
+  LabelFileHeader header;
+  memcpy(header.magic, magic, 4);
+  header.h = h;
+  header.w = w;
+  header.reserved = 0;
+  return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+/**
+ * @brief Write a label image as a 16-bit PNG, see `writeLabels()`
+ */
+static bool writePng16(const std::string &path, const cv::Mat &labels)
+{
+  cv::Mat png(labels.rows, labels.cols, CV_16U);
+  for (int x = 0; x < labels.rows; x++)
+  {
+    const uint32_t *l = labels.ptr<uint32_t>(x);
+    uint16_t *p = png.ptr<uint16_t>(x);
+    for (int y = 0; y < labels.cols; y++)
+    {
+      if (l[y] == LABEL_REJECTED)
+        p[y] = PNG_REJECTED;
+      else if (l[y] >= PNG_REJECTED)
+        return false;
+      else
+        p[y] = (uint16_t)l[y];
+    }
+  }
+  return cv::imwrite(path, png, {cv::IMWRITE_PNG_COMPRESSION, 1});
+}
+
+bool writeLabels(const std::string &path, const cv::Mat &labels, LabelFormat format)
+{
+  if (format == LABELS_PNG16)
+    return writePng16(path, labels);
+
+  LabelFileWriter writer;
+  if (!writer.open(path, labels.rows, labels.cols, format))
+    return false;
+  for (int x = 0; x < labels.rows; x++)
+    writer.writeRow(labels.ptr<uint32_t>(x));
+  return writer.close();
+}
+
+bool LabelFileWriter::open(const std::string &path, int h, int w, LabelFormat format)
+{
+  close();
+  if (format == LABELS_PNG16)
+    return false;
+  f = fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  fmt = format;
+  rows = h;
+  cols = w;
+  written = 0;
+  failed = !writeHeader(f, format == LABELS_RAW ? RAW_MAGIC : RLE_MAGIC, h, w);
+  return !failed;
+}
+
+bool LabelFileWriter::writeRow(const uint32_t *labels)
+{
+  if (!f || failed)
+    return false;
+  written++;
+  if (fmt == LABELS_RAW)
+  {
+    failed = fwrite(labels, sizeof(uint32_t), cols, f) != (size_t)cols;
+    return !failed;
+  }
+
+  runs.assign(1, 0);
+  for (int y = 0; y < cols;)
+  {
+    int start = y;
+    while (y < cols && labels[y] == labels[start])
+      y++;
+    runs.push_back(labels[start]);
+    runs.push_back(y - start);
+    runs[0]++;
+  }
+  failed = fwrite(runs.data(), sizeof(uint32_t), runs.size(), f) != runs.size();
+  return !failed;
+}
+
+bool LabelFileWriter::close()
+{
+  if (!f)
+    return false;
+  bool ok = fclose(f) == 0 && !failed && written == rows;
+  f = NULL;
+  return ok;
+}
+
+bool LabelFileReader::open(const std::string &path)
+{
+  close();
+  if (!labelFormatFromPath(path, fmt) || fmt == LABELS_PNG16)
+    return false;
+  f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  LabelFileHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.magic, fmt == LABELS_RAW ? RAW_MAGIC : RLE_MAGIC, 4) != 0 || header.h > INT32_MAX ||
+      header.w > INT32_MAX)
+  {
+    close();
+    return false;
+  }
+  rows = header.h;
+  cols = header.w;
+  return true;
+}
+
+bool LabelFileReader::readRow(uint32_t *labels)
+{
+  if (!f)
+    return false;
+  if (fmt == LABELS_RAW)
+    return fread(labels, sizeof(uint32_t), cols, f) == (size_t)cols;
+
+  uint32_t count;
+  if (fread(&count, sizeof(count), 1, f) != 1 || count > (uint32_t)cols)
+    return false;
+  runs.resize(2 * (size_t)count);
+  if (fread(runs.data(), sizeof(uint32_t), runs.size(), f) != runs.size())
+    return false;
+  size_t y = 0;
+  for (size_t r = 0; r < runs.size(); r += 2)
+  {
+    if (runs[r + 1] > (size_t)cols - y)
+      return false;
+    std::fill(labels + y, labels + y + runs[r + 1], runs[r]);
+    y += runs[r + 1];
+  }
+  return y == (size_t)cols;
+}
+
+void LabelFileReader::close()
+{
+  if (f)
+    fclose(f);
+  f = NULL;
+}
+
+bool readLabels(const std::string &path, cv::Mat &labels)
+{
+  LabelFormat format;
+  if (!labelFormatFromPath(path, format))
+    return false;
+
+  if (format == LABELS_PNG16)
+  {
+    cv::Mat png = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (png.empty() || png.type() != CV_16U)
+      return false;
+    labels.create(png.rows, png.cols, CV_32S);
+    for (int x = 0; x < png.rows; x++)
+    {
+      const uint16_t *p = png.ptr<uint16_t>(x);
+      uint32_t *l = labels.ptr<uint32_t>(x);
+      for (int y = 0; y < png.cols; y++)
+        l[y] = p[y] == PNG_REJECTED ? LABEL_REJECTED : p[y];
+    }
+    return true;
+  }
+
+  LabelFileReader reader;
+  if (!reader.open(path))
+    return false;
+  labels.create(reader.height(), reader.width(), CV_32S);
+  for (int x = 0; x < labels.rows; x++)
+  {
+    if (!reader.readRow(labels.ptr<uint32_t>(x)))
+      return false;
+  }
+  return true;
+}
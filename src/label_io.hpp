@@ -0,0 +1,214 @@
+#ifndef LABEL_IO_HPP
+#define LABEL_IO_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "label_map.hpp"
+
+/**
+ * @brief Lossless file formats of a label map
+ *
+ * Every format keeps the label of every pixel exactly. Rejected pixels are
+ * stored as `LABEL_REJECTED` (65535 in PNG16), whatever the marker of the
+ * label map they come from.
+ */
+enum LabelFormat
+{
+  LABELS_RAW,   // 16-byte header, then h * w uint32 labels, row-major: can be mapped as is
+  LABELS_PNG16, // 16-bit grayscale PNG, fast compression, at most 65534 regions
+  LABELS_RLE    // 16-byte header, then every row as a run count and (label, length) uint32 pairs
+};
+
+// label of the rejected pixels in exported label images and label files
+const uint32_t LABEL_REJECTED = UINT32_MAX;
+
+/**
+ * @brief Format of a label file from its extension
+ *
+ * @param path Path of the file, ending with .raw, .png or .rle
+ * @param format Receives the format
+ *
+ * @return False if the extension is none of those
+ */
+bool labelFormatFromPath(const std::string &path, LabelFormat &format);
+
+/**
+ * @brief Format of a label file from its name
+ *
+ * @param name raw, png or rle
+ * @param format Receives the format
+ *
+ * @return False if the name is none of those
+ */
+bool labelFormatFromName(const char *name, LabelFormat &format);
+
+/**
+ * @brief Extension of the files of a format, with the dot
+ */
+const char *labelExtension(LabelFormat format);
+
+/**
+ * @brief The labels of a label map as a plain image
+ *
+ * @param labels The label map
+ *
+ * @return A CV_32S image of the labels, read as uint32: 0 for unassigned
+ * pixels, the region numbers, and `LABEL_REJECTED` for rejected pixels. It
+ * does not depend on the epoch or on the width of the label map.
+ */
+cv::Mat exportLabels(const LabelMap &labels);
+
+/**
+ * @brief Write a label image to a file
+ *
+ * @param path Path of the file
+ * @param labels The labels, as returned by `exportLabels()`
+ * @param format The file format
+ *
+ * @return False if the file cannot be written, or if a label does not fit
+ * in the format
+ *
+ * The raw and RLE files start with a 16-byte header of four uint32: a magic
+ * number ("RGLB" for raw, "RGLR" for RLE), the height, the width and 0.
+ * Every value is stored in host byte order, which is little-endian on x86
+ * and ARM hosts. A raw file is then the labels, row by row, so that the
+ * labels can be used in place from a mapping of the file at offset 16. An
+ * RLE file is then, for every row, the number of runs of the row followed by
+ * the label and the length of every run, which is compact for masks and
+ * for images of few, large regions.
+ */
+bool writeLabels(const std::string &path, const cv::Mat &labels, LabelFormat format);
+
+/**
+ * @brief Writer of a raw or RLE label file, one row at a time
+ *
+ * Writes the files of `writeLabels()` without holding the labels of the whole
+ * image: only one row is buffered.
+ */
+class LabelFileWriter
+{
+public:
+  LabelFileWriter() {}
+
+  ~LabelFileWriter()
+  {
+    close();
+  }
+
+  LabelFileWriter(const LabelFileWriter &) = delete;
+  LabelFileWriter &operator=(const LabelFileWriter &) = delete;
+
+  /**
+   * @brief Create a file and write its header
+   *
+   * @param path Path of the file
+   * @param h Height of the image
+   * @param w Width of the image
+   * @param format `LABELS_RAW` or `LABELS_RLE`
+   *
+   * @return False if the file cannot be written or the format is PNG16,
+   * which cannot be written by rows
+   */
+  bool open(const std::string &path, int h, int w, LabelFormat format);
+
+  /**
+   * @brief Write the next row
+   *
+   * @param labels The w labels of the row, see `exportLabels()`
+   *
+   * @return False on a write error
+   */
+  bool writeRow(const uint32_t *labels);
+
+  /**
+   * @brief Close the file
+   *
+   * @return False if a row is missing or the file could not be written
+   */
+  bool close();
+
+private:
+  FILE *f = NULL;
+  LabelFormat fmt = LABELS_RAW;
+  int rows = 0, cols = 0;
+  int written = 0;            // number of rows written
+  bool failed = false;
+  std::vector<uint32_t> runs; // run count, then (label, length) pairs of a row
+};
+
+/**
+ * @brief Reader of a raw or RLE label file, one row at a time
+ */
+class LabelFileReader
+{
+public:
+  LabelFileReader() {}
+
+  ~LabelFileReader()
+  {
+    close();
+  }
+
+  LabelFileReader(const LabelFileReader &) = delete;
+  LabelFileReader &operator=(const LabelFileReader &) = delete;
+
+  /**
+   * @brief Open a file and read its header
+   *
+   * @param path Path of the file, whose format is given by its extension
+   *
+   * @return False if the file cannot be read, or is not a raw or RLE label file
+   */
+  bool open(const std::string &path);
+
+  /**
+   * @brief Height of the image
+   */
+  int height() const
+  {
+    return rows;
+  }
+
+  /**
+   * @brief Width of the image
+   */
+  int width() const
+  {
+    return cols;
+  }
+
+  /**
+   * @brief Read the next row
+   *
+   * @param labels Receives the `width()` labels of the row
+   *
+   * @return False if the row is missing or invalid
+   */
+  bool readRow(uint32_t *labels);
+
+  /**
+   * @brief Close the file
+   */
+  void close();
+
+private:
+  FILE *f = NULL;
+  LabelFormat fmt = LABELS_RAW;
+  int rows = 0, cols = 0;
+  std::vector<uint32_t> runs; // (label, length) pairs of a row
+};
+
+/**
+ * @brief Read a label file
+ *
+ * @param path Path of the file, whose format is given by its extension
+ * @param labels Receives the labels, as `exportLabels()` gives them
+ *
+ * @return False if the file cannot be read or is not a valid label file
+ */
+bool readLabels(const std::string &path, cv::Mat &labels);
+
+#endif
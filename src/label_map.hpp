@@ -0,0 +1,381 @@
+#ifndef LABEL_MAP_HPP
+#define LABEL_MAP_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <string.h>
+#include "region_journal.hpp"
+
+/**
+ * @brief Compact per-pixel region labels
+ *
+ * Stores one label per pixel as uint16 when the number of regions allows it,
+ * and as 32-bit otherwise, instead of a double per pixel. Label 0 means "not
+ * assigned yet". The label after the last region, `maxLabel()`, is never used
+ * as a region number and is free for the caller to use as a marker.
+ *
+ * The labels are kept in a continuous cv::Mat of type CV_16U or CV_32S,
+ * available through `mat()`. They are stored with the offset of the current
+ * epoch: `nextEpoch()` sets every label back to 0 by raising the offset, so
+ * that stale values of the previous epochs read as 0, instead of writing the
+ * whole map.
+ *
+ * Labeling needs a bound of the regions before it starts, which for a flood
+ * fill is the pixel count, so images of more than 65534 pixels are labeled on
+ * 32 bits. Once the regions are known, `narrow()` rewrites the labels on 16
+ * bits in place when they fit, which halves what every later pass reads and
+ * the copies made of them; the next epoch labels on 32 bits again.
+ */
+class LabelMap
+{
+public:
+  LabelMap() {}
+
+  /**
+   * @brief Construct a label map, see `create()`
+   */
+  LabelMap(int h, int w, size_t max_regions)
+  {
+    create(h, w, max_regions);
+  }
+
+  /**
+   * @brief Allocate the label map and set every label to 0
+   *
+   * @param h Height of the image
+   * @param w Width of the image
+   * @param max_regions Upper bound of the number of regions that will be labeled
+   *
+   * @param storage Room for `storageBytes(h, w, max_regions)` bytes to keep
+   * the labels in, which must outlive the map, or NULL to allocate it
+   *
+   * Picks 16-bit labels if `max_regions` fits below the 16-bit marker value,
+   * 32-bit labels otherwise.
+   */
+  void create(int h, int w, size_t max_regions, void *storage = NULL)
+  {
+    wide = max_regions >= UINT16_MAX;
+    cols = w;
+    marker = (uint32_t)max_regions + 1;
+    storedMarker = marker;
+    base = 0;
+    narrowed.release();
+    if (storage)
+    {
+      labels = cv::Mat(h, w, wide ? CV_32S : CV_16U, storage);
+      labels.setTo(0);
+    }
+    else
+      labels = cv::Mat::zeros(h, w, wide ? CV_32S : CV_16U);
+  }
+
+  /**
+   * @brief Bytes of storage of a label map, see `create()`
+   */
+  static size_t storageBytes(int h, int w, size_t max_regions)
+  {
+    return (size_t)h * w * (max_regions >= UINT16_MAX ? sizeof(uint32_t) : sizeof(uint16_t));
+  }
+
+  /**
+   * @brief Set every label to 0 for a new image, reusing the storage if possible
+   *
+   * @param h Height of the image
+   * @param w Width of the image
+   * @param max_regions Upper bound of the number of regions that will be labeled
+   *
+   * Starts a new epoch when the map already has this size and label width,
+   * and falls back to `create()` otherwise.
+   */
+  void reset(int h, int w, size_t max_regions)
+  {
+    if (labels.rows == h && labels.cols == w && (max_regions >= UINT16_MAX) == (labels.type() == CV_32S) &&
+        (uint32_t)max_regions < storedMarker)
+      nextEpoch();
+    else
+      create(h, w, max_regions);
+  }
+
+  /**
+   * @brief Set every label back to 0 without writing the map
+   *
+   * Raises the offset of the stored labels past every value of the current
+   * epoch. Only once the offset reaches the limit of the storage type is the
+   * map actually cleared, every `storageMax() / maxLabel()` epochs.
+   */
+  void nextEpoch()
+  {
+    if (!narrowed.empty())
+      clear();
+    else if ((uint64_t)base + 2 * (uint64_t)marker > storageMax())
+      clear();
+    else
+      base += marker;
+  }
+
+  /**
+   * @brief Free the label map
+   */
+  void release()
+  {
+    labels.release();
+    narrowed.release();
+  }
+
+  /**
+   * @brief Set every label back to 0, at the width the map was created with
+   */
+  void clear()
+  {
+    if (!narrowed.empty())
+    {
+      narrowed.release();
+      wide = true;
+      marker = storedMarker;
+    }
+    labels.setTo(0);
+    base = 0;
+  }
+
+  /**
+   * @brief Rewrite 32-bit labels on 16 bits in place, once the regions are known
+   *
+   * @param regions Number of regions: every label is in 1..regions, 0 or `maxLabel()`
+   *
+   * @return Whether the labels were narrowed; they are not if they are
+   * 16-bit already or if `regions + 1` does not fit below the 16-bit marker
+   *
+   * `maxLabel()` becomes `regions + 1`, and `mat()` a CV_16U view of the
+   * first half of the storage, which is kept. The epoch offset is removed.
+   * `nextEpoch()` and `clear()` go back to 32-bit labels.
+   */
+  bool narrow(uint32_t regions)
+  {
+    if (!wide || (uint64_t)regions + 1 >= UINT16_MAX)
+      return false;
+    uchar *data = labels.data;
+    size_t n = labels.total();
+    // the 16-bit label i overwrites bytes of 32-bit labels before i only,
+    // which are read already; memcpy keeps the compiler from assuming the
+    // two widths do not alias
+    for (size_t i = 0; i < n; i++)
+    {
+      uint32_t stored;
+      memcpy(&stored, data + 4 * i, sizeof(stored));
+      uint32_t label = stored > base ? stored - base : 0;
+      uint16_t value = (uint16_t)(label == marker ? regions + 1 : label);
+      memcpy(data + 2 * i, &value, sizeof(value));
+    }
+    narrowed = cv::Mat(labels.rows, labels.cols, CV_16U, data);
+    wide = false;
+    marker = regions + 1;
+    base = 0;
+    return true;
+  }
+
+  /**
+   * @brief Label of the pixel at linear index idx (x * w + y)
+   */
+  uint32_t get(int idx) const
+  {
+    uint32_t stored = wide ? ((const uint32_t *)labels.data)[idx] : ((const uint16_t *)labels.data)[idx];
+    return stored > base ? stored - base : 0;
+  }
+
+  /**
+   * @brief Label of the pixel at row x, column y
+   */
+  uint32_t get(int x, int y) const
+  {
+    return get(x * cols + y);
+  }
+
+  /**
+   * @brief Set the label of the pixel at linear index idx (x * w + y)
+   */
+  void set(int idx, uint32_t label)
+  {
+    if (wide)
+      ((uint32_t *)labels.data)[idx] = base + label;
+    else
+      ((uint16_t *)labels.data)[idx] = (uint16_t)(base + label);
+  }
+
+  /**
+   * @brief Set the label of the pixel at row x, column y
+   */
+  void set(int x, int y, uint32_t label)
+  {
+    set(x * cols + y, label);
+  }
+
+  /**
+   * @brief Atomically label a pixel if it is not assigned yet
+   *
+   * @param idx Linear index of the pixel
+   * @param label The label, > 0
+   *
+   * @return Whether this call labeled the pixel; false if it was assigned,
+   * possibly by a concurrent call
+   *
+   * The label is written with a compare-and-swap, so concurrent threads may
+   * race to claim a pixel and exactly one wins. Only `claim()`, `available()`
+   * and `unclaim()` may be used while other threads label the map.
+   */
+  bool claim(int idx, uint32_t label)
+  {
+    if (wide)
+      return claimAs((uint32_t *)labels.data + idx, base + label);
+    return claimAs((uint16_t *)labels.data + idx, (uint16_t)(base + label));
+  }
+
+  /**
+   * @brief Whether a pixel is not assigned yet, safe to call concurrently with `claim()`
+   */
+  bool available(int idx) const
+  {
+    if (wide)
+      return __atomic_load_n((const uint32_t *)labels.data + idx, __ATOMIC_RELAXED) <= base;
+    return __atomic_load_n((const uint16_t *)labels.data + idx, __ATOMIC_RELAXED) <= base;
+  }
+
+  /**
+   * @brief Set a pixel claimed by the caller back to 0, safe to call concurrently with `claim()`
+   */
+  void unclaim(int idx)
+  {
+    if (wide)
+      __atomic_store_n((uint32_t *)labels.data + idx, base, __ATOMIC_RELAXED);
+    else
+      __atomic_store_n((uint16_t *)labels.data + idx, (uint16_t)base, __ATOMIC_RELAXED);
+  }
+
+  /**
+   * @brief Undo the region recorded in a journal
+   *
+   * @param journal Journal of the pixels claimed by the region
+   * @param fill Label written back to every claimed pixel
+   */
+  void rollback(RegionJournal &journal, uint32_t fill = 0)
+  {
+    if (wide)
+      journal.rollback((uint32_t *)labels.data, base + fill);
+    else
+      journal.rollback((uint16_t *)labels.data, (uint16_t)(base + fill));
+  }
+
+  /**
+   * @brief Copy the labels to another map
+   *
+   * @param dst Receives the labels, stored without epoch offset, and the
+   * marker. Its storage is kept, possibly the caller's memory, if it has the
+   * size and the label width of this map; it is allocated again otherwise.
+   */
+  void copyTo(LabelMap &dst) const
+  {
+    if (dst.labels.rows != labels.rows || dst.labels.cols != labels.cols || dst.isWide() != wide ||
+        !dst.narrowed.empty() || dst.labels.empty())
+      dst.create(labels.rows, labels.cols, marker - 1);
+    dst.marker = marker;
+    dst.base = 0;
+    size_t n = labels.total();
+    if (wide)
+      copyLabels((const uint32_t *)labels.data, (uint32_t *)dst.labels.data, n);
+    else
+      copyLabels((const uint16_t *)labels.data, (uint16_t *)dst.labels.data, n);
+  }
+
+  /**
+   * @brief Label reserved as a marker, max_regions + 1
+   */
+  uint32_t maxLabel() const
+  {
+    return marker;
+  }
+
+  /**
+   * @brief Whether labels are stored on 32 bits
+   */
+  bool isWide() const
+  {
+    return wide;
+  }
+
+  /**
+   * @brief The stored labels as a CV_16U or CV_32S image
+   *
+   * The stored values are offset by the current epoch; they are the labels
+   * only until the first `nextEpoch()` or after a `clear()`.
+   */
+  const cv::Mat &mat() const
+  {
+    return narrowed.empty() ? labels : narrowed;
+  }
+
+private:
+  /**
+   * @brief Compare-and-swap a stored label from any unassigned value to `desired`
+   */
+  template <typename T>
+  bool claimAs(T *stored, T desired)
+  {
+    T current = __atomic_load_n(stored, __ATOMIC_RELAXED);
+    while (current <= base)
+    {
+      if (__atomic_compare_exchange_n(stored, &current, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Copy n stored labels, removing the epoch offset
+   */
+  template <typename T>
+  void copyLabels(const T *src, T *dst, size_t n) const
+  {
+    if (base == 0)
+    {
+      memcpy(dst, src, n * sizeof(T));
+      return;
+    }
+    const T b = (T)base;
+    for (size_t i = 0; i < n; i++)
+      dst[i] = src[i] > b ? src[i] - b : 0;
+  }
+
+  /**
+   * @brief Largest value of the storage type
+   */
+  uint32_t storageMax() const
+  {
+    return wide ? INT32_MAX : UINT16_MAX;
+  }
+
+  cv::Mat labels;   // the storage, at the width the map was created with
+  cv::Mat narrowed; // 16-bit view of the storage after narrow(), empty otherwise
+  int cols = 0;
+  bool wide = false;
+  uint32_t marker = 1;       // maxLabel()
+  uint32_t storedMarker = 1; // maxLabel() of the storage width
+  uint32_t base = 0;         // offset of the labels of the current epoch
+};
+
+/**
+ * @brief Display color of a region label
+ *
+ * @param label The label, > 0
+ *
+ * @return A color that is never white. Multiplying by an odd number is a
+ * bijection of 24-bit values, so labels below 2^24 never share a color, and
+ * consecutive labels get far apart colors.
+ */
+inline cv::Vec3b labelColor(uint32_t label)
+{
+  uint32_t rgb = (label * 0x9E3779u) & 0xFFFFFFu;
+  if (rgb == 0xFFFFFFu)
+    rgb = 0; // the color of label 0, which is no region, instead of white
+  return cv::Vec3b(rgb & 0xFF, (rgb >> 8) & 0xFF, rgb >> 16);
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "merge_tree.hpp"
+#include <algorithm>
+
+// forward neighbours (dx, dy) of a pixel, in the order of the direction ids:
+// right, below, then the two diagonals below for 8-connectivity
+static const int FORWARD_DX[4] = {0, 1, 1, 1};
+static const int FORWARD_DY[4] = {1, 0, -1, 1};
+
+/**
+ * @brief Call f(pair id, distance) for every neighbour pair of an image
+ *
+ * @param im The image, 8-bit of CN channels
+ * @param directions 2 for 4-connectivity, 4 for 8-connectivity
+ * @param f The callback; a pair id is the index of its first pixel times 4,
+ * plus the direction of the second pixel
+ */
+template <int CN, ColorMetric M, typename F>
+static void forEachPair(const cv::Mat &im, int directions, F &&f)
+{
+  int h = im.rows, w = im.cols;
+  for (int x = 0; x < h; x++)
+  {
+    const uchar *row = im.ptr<uchar>(x);
+    for (int d = 0; d < directions; d++)
+    {
+      int dx = FORWARD_DX[d], dy = FORWARD_DY[d];
+      if (x + dx >= h)
+        continue;
+      const uchar *next = im.ptr<uchar>(x + dx);
+      int y0 = std::max(0, -dy), y1 = std::min(w, w - dy);
+      for (int y = y0; y < y1; y++)
+        f((uint32_t)(x * w + y) * 4 + d, (uint32_t)pixelDistance<M, CN>(row + CN * y, next + CN * (y + dy)));
+    }
+  }
+}
+
+/**
+ * @brief Sort the neighbour pairs of an image by distance
+ *
+ * @param im The image
+ * @param directions See `forEachPair()`
+ * @param sorted Receives the pair ids in increasing distance
+ * @param end Receives, for every distance d, the end of the pairs at distance d in `sorted`
+ *
+ * A counting sort: a first pass counts the pairs at every distance, a second
+ * one computes the distances again and places every pair. Recomputing is
+ * cheaper than storing one distance per pair.
+ */
+template <int CN, ColorMetric M>
+static void sortPairs(const cv::Mat &im, int directions, std::vector<uint32_t> &sorted, std::vector<uint32_t> &end)
+{
+  int span = M == METRIC_L2 ? CN * 255 * 255 : M == METRIC_L1 ? CN * 255 : 255;
+  std::vector<uint32_t> start(span + 2, 0);
+  forEachPair<CN, M>(im, directions, [&](uint32_t, uint32_t dist) { start[dist + 1]++; });
+  for (int d = 1; d <= span + 1; d++)
+    start[d] += start[d - 1];
+  sorted.resize(start[span + 1]);
+  forEachPair<CN, M>(im, directions, [&](uint32_t pair, uint32_t dist) { sorted[start[dist]++] = pair; });
+  start.pop_back(); // start[d] has moved to the end of distance d
+  end.swap(start);
+}
+
+template <int CN>
+static void sortPairs(const cv::Mat &im, ColorMetric metric, int directions, std::vector<uint32_t> &sorted,
+                      std::vector<uint32_t> &end)
+{
+  if (metric == METRIC_L1)
+    sortPairs<CN, METRIC_L1>(im, directions, sorted, end);
+  else if (metric == METRIC_CHEBYSHEV)
+    sortPairs<CN, METRIC_CHEBYSHEV>(im, directions, sorted, end);
+  else
+    sortPairs<CN, METRIC_L2>(im, directions, sorted, end);
+}
+
+bool MergeTree::supports(int type)
+{
+  int cn = CV_MAT_CN(type);
+  return CV_MAT_DEPTH(type) == CV_8U && (cn == 1 || cn == 3 || cn == 4);
+}
+
+void MergeTree::build(const cv::Mat &im, ColorMetric metric, int connectivity)
+{
+  if (!supports(im.type()))
+    CV_Error(cv::Error::StsUnsupportedFormat, "the merge tree needs an 8-bit image of 1, 3 or 4 channels");
+  CV_Assert(connectivity == 4 || connectivity == 8);
+  int h = im.rows, w = im.cols;
+  CV_Assert((size_t)h * w < ((size_t)1 << 30)); // pair ids fit in 32 bits
+
+  int directions = connectivity == 8 ? 4 : 2;
+  std::vector<uint32_t> sorted, end;
+  if (im.channels() == 1)
+    sortPairs<1>(im, metric, directions, sorted, end);
+  else if (im.channels() == 3)
+    sortPairs<3>(im, metric, directions, sorted, end);
+  else
+    sortPairs<4>(im, metric, directions, sorted, end);
+
+  for (int d = 0; d < 4; d++)
+    delta[d] = FORWARD_DX[d] * w + FORWARD_DY[d];
+  size_t n = (size_t)h * w;
+  mergeEdge.clear();
+  mergeDist.clear();
+  mergeEdge.reserve(n > 0 ? n - 1 : 0);
+  mergeDist.reserve(n > 0 ? n - 1 : 0);
+  sets.reset((uint32_t)n);
+  size_t first = 0;
+  for (uint32_t dist = 0; dist < end.size() && mergeEdge.size() + 1 < n; dist++)
+  {
+    for (size_t i = first; i < end[dist]; i++)
+    {
+      uint32_t pair = sorted[i], idx = pair >> 2;
+      uint32_t a = sets.find(idx + 1), b = sets.find(idx + delta[pair & 3] + 1);
+      if (a != b)
+      {
+        sets.unite(a, b);
+        mergeEdge.push_back(pair);
+        mergeDist.push_back(dist);
+      }
+    }
+    first = end[dist];
+  }
+
+  sets.reset((uint32_t)n);
+  applied = 0;
+  source = im;
+  this->metric = metric;
+  this->connectivity = connectivity;
+}
+
+bool MergeTree::builtFor(const cv::Mat &im, ColorMetric metric, int connectivity) const
+{
+  return !source.empty() && metric == this->metric && connectivity == this->connectivity &&
+         source.data == im.data && source.rows == im.rows && source.cols == im.cols &&
+         source.type() == im.type() && (size_t)source.step == (size_t)im.step;
+}
+
+int MergeTree::labels(double thresh, LabelMap &labels, int min_region, uint64_t *rejected)
+{
+  CV_Assert(!source.empty() && labels.mat().rows == source.rows && labels.mat().cols == source.cols);
+  uint32_t n = (uint32_t)((size_t)source.rows * source.cols);
+  int bound = distanceBound<uchar>(metric, thresh);
+  size_t merges = std::lower_bound(mergeDist.begin(), mergeDist.end(), (uint32_t)bound) - mergeDist.begin();
+
+  // the sets of the previous call are those of its prefix of merges: keep
+  // them unless this prefix is shorter, so that an ascending sweep applies
+  // every merge once
+  if (merges < applied)
+  {
+    sets.reset(n);
+    applied = 0;
+  }
+  for (size_t i = applied; i < merges; i++)
+  {
+    uint32_t idx = mergeEdge[i] >> 2;
+    sets.unite(idx + 1, idx + delta[mergeEdge[i] & 3] + 1);
+  }
+  sets.flatten();
+  applied = merges;
+
+  // the root of a region is its first pixel in raster order, so numbering
+  // roots in raster order numbers regions like the serial flood fill;
+  // number holds the area of every root until it is numbered
+  number.assign(n + 1, 0);
+  if (min_region > 0)
+  {
+    for (uint32_t id = 1; id <= n; id++)
+      number[sets.find(id)]++;
+  }
+  int regions = 0;
+  uint64_t small = 0;
+  for (uint32_t id = 1; id <= n; id++)
+  {
+    uint32_t root = sets.find(id);
+    if (root == id)
+    {
+      if (min_region <= 0 || number[id] >= (uint32_t)min_region)
+        number[id] = ++regions;
+      else
+      {
+        number[id] = labels.maxLabel();
+        small++;
+      }
+    }
+    labels.set((int)(id - 1), number[root]);
+  }
+  if (rejected)
+    *rejected = small;
+  return regions;
+}
+
+void MergeTree::clear()
+{
+  source.release();
+  mergeEdge.clear();
+  mergeDist.clear();
+  sets.clear();
+  applied = 0;
+}
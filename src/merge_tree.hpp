@@ -0,0 +1,87 @@
+#ifndef MERGE_TREE_HPP
+#define MERGE_TREE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <vector>
+#include "color_distance.hpp"
+#include "label_map.hpp"
+#include "union_find.hpp"
+
+/**
+ * @brief Merges of the regions of an image at every threshold at once
+ *
+ * Two neighbours belong to the same region at threshold t exactly when they
+ * are joined by a path of neighbour pairs closer than t. Kruskal's algorithm
+ * over the neighbour pairs in increasing distance keeps the pairs that join
+ * two distinct regions, at most one per pixel; the regions at threshold t are
+ * then the sets joined by the kept pairs closer than t, a prefix of them.
+ *
+ * `build()` computes the distance of every pair once, sorts the pairs by
+ * distance with a counting sort, as the distances of 8-bit pixels are small
+ * integers, and runs Kruskal's algorithm. `labels()` then labels the image at
+ * any threshold in O(N), without testing a single pixel again, so that a
+ * sweep over many thresholds costs little more than one segmentation. The
+ * regions of the last threshold are kept, and a higher threshold only adds
+ * its further merges to them: sweep thresholds in ascending order.
+ */
+class MergeTree
+{
+public:
+  /**
+   * @brief Whether `build()` supports images of a type: 8-bit, 1, 3 or 4 channels
+   */
+  static bool supports(int type);
+
+  /**
+   * @brief Build the merges of an image
+   *
+   * @param im The image, see `supports()`; a reference to it is kept for `builtFor()`
+   * @param metric Distance between two pixels
+   * @param connectivity 4 or 8
+   */
+  void build(const cv::Mat &im, ColorMetric metric = METRIC_L2, int connectivity = 8);
+
+  /**
+   * @brief Whether the merges are those of an image, metric and connectivity
+   *
+   * The image is recognized by its memory, like `ColorCache` does.
+   */
+  bool builtFor(const cv::Mat &im, ColorMetric metric, int connectivity) const;
+
+  /**
+   * @brief Label the regions at a threshold
+   *
+   * @param thresh Color distance below which neighbours join a region
+   * @param labels Label map of the image, sized for h * w regions; every
+   * pixel is written
+   * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+   * @param rejected If not NULL, receives the number of regions rejected for
+   * being smaller than `min_region`
+   *
+   * @return The number of regions
+   *
+   * The labels are those of the serial flood fill with the same metric and
+   * connectivity: 1..n in raster order of the first pixel of each region, and
+   * `labels.maxLabel()` for the pixels of rejected regions.
+   */
+  int labels(double thresh, LabelMap &labels, int min_region = 0, uint64_t *rejected = NULL);
+
+  /**
+   * @brief Forget the merges and the image
+   */
+  void clear();
+
+private:
+  cv::Mat source;                   // image of the merges
+  ColorMetric metric = METRIC_L2;
+  int connectivity = 8;
+  std::vector<uint32_t> mergeEdge;  // pairs joining two regions, in increasing distance: pixel * 4 + direction
+  std::vector<uint32_t> mergeDist;  // their distances, from pixelDistance()
+  int delta[4] = {};                // index offset of the neighbour in each direction
+  UnionFind sets;                   // regions of the last labels(), after the first `applied` merges
+  size_t applied = 0;
+  std::vector<uint32_t> number;     // area of each root, then its label
+};
+
+#endif
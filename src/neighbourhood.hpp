@@ -0,0 +1,161 @@
+#ifndef NEIGHBOURHOOD_HPP
+#define NEIGHBOURHOOD_HPP
+
+/**
+ * @brief Precomputed pixel neighbourhood of an h x w image
+ *
+ * Holds the row/column offsets of the 4- or 8-connected neighbours and the
+ * matching linear index deltas (dx * w + dy). Interior pixels are visited
+ * without any bounds check; only pixels on the image border pay for it.
+ * Neighbours are visited row by row, top-left first.
+ *
+ * The 8 neighbours of a pixel are numbered by slot, in visiting order:
+ *
+ *     0 1 2
+ *     3 . 4
+ *     5 6 7
+ *
+ * so that slot `7 - k` is the opposite of slot k. Bit k of a neighbour mask
+ * (see `forEachIn()`) refers to slot k, whatever the connectivity.
+ */
+class Neighbourhood
+{
+public:
+  Neighbourhood() {}
+
+  /**
+   * @brief Constructs the neighbourhood of an image
+   *
+   * @param h Height of the image
+   * @param w Width of the image
+   * @param connectivity 4 or 8
+   */
+  Neighbourhood(int h, int w, int connectivity = 8) : h(h), w(w), n(0), allowed(0)
+  {
+    int k = 0;
+    for (int i = -1; i <= 1; ++i)
+    {
+      for (int j = -1; j <= 1; ++j)
+      {
+        if (i == 0 && j == 0)
+          continue;
+        dx[k] = i;
+        dy[k] = j;
+        delta[k] = i * w + j;
+        if (connectivity == 8 || i == 0 || j == 0)
+        {
+          slots[n++] = k;
+          allowed |= 1u << k;
+        }
+        k++;
+      }
+    }
+  }
+
+  /**
+   * @brief Number of neighbours of an interior pixel (4 or 8)
+   */
+  int size() const
+  {
+    return n;
+  }
+
+  /**
+   * @brief Neighbour mask with the bits of the slots in use
+   */
+  unsigned mask() const
+  {
+    return allowed;
+  }
+
+  /**
+   * @brief Slot of the neighbour opposite to slot k
+   */
+  static int opposite(int k)
+  {
+    return 7 - k;
+  }
+
+  /**
+   * @brief Check if the given coordinates are within the image
+   */
+  bool contains(int x, int y) const
+  {
+    return x >= 0 && x < h && y >= 0 && y < w;
+  }
+
+  /**
+   * @brief Check if all the neighbours of a pixel are within the image
+   */
+  bool interior(int x, int y) const
+  {
+    return x > 0 && x < h - 1 && y > 0 && y < w - 1;
+  }
+
+  /**
+   * @brief Visit the neighbours of a pixel
+   *
+   * @param x The x-coordinate of the pixel
+   * @param y The y-coordinate of the pixel
+   * @param f Callable as `bool f(int nx, int ny, int nidx)`, where nidx is the
+   * linear index of the neighbour; returning false stops the visit
+   *
+   * Only neighbours within the image are visited.
+   */
+  template <typename F>
+  void forEach(int x, int y, F &&f) const
+  {
+    int idx = x * w + y;
+    if (interior(x, y))
+    {
+      for (int s = 0; s < n; ++s)
+      {
+        int k = slots[s];
+        if (!f(x + dx[k], y + dy[k], idx + delta[k]))
+          return;
+      }
+      return;
+    }
+    for (int s = 0; s < n; ++s)
+    {
+      int k = slots[s];
+      int nx = x + dx[k], ny = y + dy[k];
+      if (contains(nx, ny) && !f(nx, ny, idx + delta[k]))
+        return;
+    }
+  }
+
+  /**
+   * @brief Visit the neighbours of a pixel selected by a neighbour mask
+   *
+   * @param x The x-coordinate of the pixel
+   * @param y The y-coordinate of the pixel
+   * @param bits Neighbour mask, bit k selecting slot k
+   * @param f Callable as in `forEach()`
+   *
+   * No bounds check is done: the caller guarantees that `bits` only selects
+   * neighbours within the image, as the masks of `SimilarityMap` do. Slots
+   * not in use for the connectivity are ignored.
+   */
+  template <typename F>
+  void forEachIn(int x, int y, unsigned bits, F &&f) const
+  {
+    int idx = x * w + y;
+    bits &= allowed;
+    while (bits)
+    {
+      int k = __builtin_ctz(bits);
+      bits &= bits - 1;
+      if (!f(x + dx[k], y + dy[k], idx + delta[k]))
+        return;
+    }
+  }
+
+private:
+  int h = 0, w = 0, n = 0;
+  unsigned allowed = 0;
+  int dx[8] = {}, dy[8] = {}, delta[8] = {};
+  int slots[8] = {};
+};
+
+#endif
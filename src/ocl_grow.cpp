@@ -0,0 +1,128 @@
+#include "ocl_grow.hpp"
+#include <vector>
+
+// rounds of propagation between two reads of the change flag
+static const int PASSES_PER_ROUND = 4;
+
+static const char *const kernelSource = R"CL(
+// row and column offsets of the neighbour in slot k
+__constant int SLOT_DX[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+__constant int SLOT_DY[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+// mask of the neighbours of a pixel closer than thresh2, bit k for slot k;
+// only the slots of the neighbourhood are tested, so that the masks are
+// those SimilarityMap::compute() gives for the same connectivity
+__kernel void rg_similar(__global const uchar *src, int src_step, int src_offset, int rows, int cols,
+                         __global uchar *masks, int thresh2, uint slots)
+{
+  int y = get_global_id(0), x = get_global_id(1);
+  if (x >= rows || y >= cols)
+    return;
+  __global const uchar *p = src + src_offset + x * src_step + 3 * y;
+  uint bits = 0;
+#pragma unroll
+  for (int k = 0; k < 8; k++)
+  {
+    int nx = x + SLOT_DX[k], ny = y + SLOT_DY[k];
+    if ((slots & (1u << k)) && nx >= 0 && nx < rows && ny >= 0 && ny < cols)
+    {
+      __global const uchar *q = src + src_offset + nx * src_step + 3 * ny;
+      int d0 = p[0] - q[0], d1 = p[1] - q[1], d2 = p[2] - q[2];
+      if (d0 * d0 + d1 * d1 + d2 * d2 < thresh2)
+        bits |= 1u << k;
+    }
+  }
+  masks[x * cols + y] = (uchar)bits;
+}
+
+__kernel void rg_init(__global int *labels, int rows, int cols)
+{
+  int y = get_global_id(0), x = get_global_id(1);
+  if (x < rows && y < cols)
+    labels[x * cols + y] = x * cols + y;
+}
+
+// lowers the label of a pixel to the smallest label of its similar
+// neighbours; only the work item of a pixel writes its label, and labels
+// read while others are written are older, larger values of the same region
+__kernel void rg_propagate(__global const uchar *masks, __global int *labels, int rows, int cols,
+                           __global int *changed)
+{
+  int y = get_global_id(0), x = get_global_id(1);
+  if (x >= rows || y >= cols)
+    return;
+  int idx = x * cols + y;
+  int old = labels[idx];
+  int l = old;
+  uint bits = masks[idx];
+#pragma unroll
+  for (int k = 0; k < 8; k++)
+  {
+    if (bits & (1u << k))
+      l = min(l, labels[labels[idx + SLOT_DX[k] * cols + SLOT_DY[k]]]);
+  }
+  l = labels[l];
+  if (l < old)
+  {
+    labels[idx] = l;
+    changed[0] = 1;
+  }
+}
+)CL";
+
+int growOpenCL(const cv::UMat &im, int thresh2, unsigned slots, LabelMap &labels, int min_region,
+               SimilarityMap *similar)
+{
+  if (!cv::ocl::useOpenCL())
+    return -1;
+  CV_Assert(im.type() == CV_8UC3);
+  const int h = im.rows, w = im.cols;
+  if (h == 0 || w == 0)
+    return 0;
+
+  static const cv::ocl::ProgramSource source(kernelSource);
+  cv::ocl::Kernel similarK("rg_similar", source), initK("rg_init", source), propagateK("rg_propagate", source);
+  if (similarK.empty() || initK.empty() || propagateK.empty())
+    return -1;
+
+  cv::UMat masks(h, w, CV_8U), deviceLabels(h, w, CV_32S), changed(1, 1, CV_32S);
+  size_t global[2] = {(size_t)w, (size_t)h};
+  similarK.args(cv::ocl::KernelArg::ReadOnly(im), cv::ocl::KernelArg::PtrWriteOnly(masks), thresh2, slots);
+  initK.args(cv::ocl::KernelArg::PtrWriteOnly(deviceLabels), h, w);
+  propagateK.args(cv::ocl::KernelArg::PtrReadOnly(masks), cv::ocl::KernelArg::PtrReadWrite(deviceLabels), h, w,
+                  cv::ocl::KernelArg::PtrReadWrite(changed));
+  if (!similarK.run(2, global, NULL, false) || !initK.run(2, global, NULL, false))
+    return -1;
+
+  for (bool again = true; again;)
+  {
+    changed.setTo(0);
+    for (int pass = 0; pass < PASSES_PER_ROUND; pass++)
+    {
+      if (!propagateK.run(2, global, NULL, false))
+        return -1;
+    }
+    again = changed.getMat(cv::ACCESS_READ).at<int>(0) != 0;
+  }
+
+  cv::Mat roots;
+  deviceLabels.copyTo(roots);
+  if (similar)
+    similar->load(masks);
+
+  // a root is the first pixel of its region, so it is numbered before any
+  // other pixel of the region reads its number; count holds the area of a
+  // root until then, and its number afterwards
+  const int *root = roots.ptr<int>();
+  std::vector<uint32_t> count((size_t)h * w, 0);
+  for (int idx = 0; idx < h * w; idx++)
+    count[root[idx]]++;
+  int regions = 0;
+  for (int idx = 0; idx < h * w; idx++)
+  {
+    if (root[idx] == idx)
+      count[idx] = count[idx] >= (uint32_t)min_region ? ++regions : labels.maxLabel();
+    labels.set(idx, count[root[idx]]);
+  }
+  return regions;
+}
@@ -0,0 +1,40 @@
+#ifndef OCL_GROW_HPP
+#define OCL_GROW_HPP
+
+#include <opencv2/opencv.hpp>
+#include "label_map.hpp"
+#include "similarity_map.hpp"
+
+/**
+ * @brief Label the regions of an image on an OpenCL device
+ *
+ * @param im The CV_8UC3 image, in device memory
+ * @param thresh2 Squared distance bound, see `squaredThreshold()`
+ * @param slots Neighbour mask of the connectivity, see `Neighbourhood::mask()`
+ * @param labels Label map of the image, all zeros, sized for h * w regions
+ * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+ * @param similar If not NULL, receives the similarity masks of the image
+ *
+ * @return The number of regions, or -1 if OpenCL is not available or its
+ * kernels cannot be built, in which case nothing is written
+ *
+ * The similarity masks are computed on the device. Every pixel then starts
+ * with its own linear index as label, and a propagation kernel repeatedly
+ * lowers the label of every pixel to the smallest label of its similar
+ * neighbours, following the label it reads once more to jump along chains.
+ * The labels only decrease and always name a pixel of the same region, so
+ * they converge to the index of the first pixel of every region in raster
+ * order. A device flag reports whether a round of passes changed any label;
+ * only that flag is read back between rounds. The labels and, if asked, the
+ * masks are downloaded once at the end, and the regions are numbered on the
+ * host in a single pass, which gives the labels of the serial scan, including
+ * the rejection of regions smaller than `min_region`.
+ *
+ * The number of rounds grows with the length of the longest region along
+ * which labels must travel, divided by the chain jumps, so winding regions
+ * need more of them than compact ones.
+ */
+int growOpenCL(const cv::UMat &im, int thresh2, unsigned slots, LabelMap &labels, int min_region,
+               SimilarityMap *similar = NULL);
+
+#endif
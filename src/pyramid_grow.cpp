@@ -0,0 +1,306 @@
+#include "pyramid_grow.hpp"
+#include <vector>
+#include "frontier.hpp"
+#include "scan_label.hpp"
+
+/**
+ * @brief Grow the labels of the pixels of a frontier into their unlabeled similar neighbours
+ */
+static void spread(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels, Frontier &frontier,
+                   int w)
+{
+  while (!frontier.empty())
+  {
+    int idx = frontier.pop();
+    uint32_t label = labels.get(idx);
+    nbh.forEachIn(idx / w, idx % w, similar.bits(idx), [&](int, int, int nidx)
+    {
+      if (labels.get(nidx) == 0)
+      {
+        labels.set(nidx, label);
+        frontier.push(nidx);
+      }
+      return true;
+    });
+  }
+}
+
+// inverse of the part of a level in the band above which its similarity masks are computed in one pass
+static const size_t BAND_FULL_PASS = 4;
+
+// row and column offsets of the neighbour in slot k
+static const int SLOT_DX[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static const int SLOT_DY[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+// state of a pixel of a pyramid level, for the level below
+enum PixelState : uint8_t
+{
+  PIXEL_BAND,    // near a region boundary: its pixels below are grown again
+  PIXEL_INTERIOR // similar to all its neighbours, which share its label: its pixels below keep the label
+};
+
+/**
+ * @brief Slots of the neighbours of a pixel that lie within the level
+ */
+static unsigned insideSlots(const Neighbourhood &nbh, int x, int y, int h, int w)
+{
+  unsigned inside = nbh.mask();
+  if (x == 0)
+    inside &= ~0x07u; // slots 0, 1, 2: row above
+  if (x == h - 1)
+    inside &= ~0xE0u; // slots 5, 6, 7: row below
+  if (y == 0)
+    inside &= ~0x29u; // slots 0, 3, 5: left column
+  if (y == w - 1)
+    inside &= ~0x94u; // slots 2, 4, 7: right column
+  return inside;
+}
+
+/**
+ * @brief Whether a pixel whose mask is computed is interior: similar to all its neighbours, which share its label
+ */
+static bool isInterior(const SimilarityMap &similar, const Neighbourhood &nbh, const LabelMap &labels, int idx,
+                       int h, int w)
+{
+  int x = idx / w, y = idx % w;
+  unsigned inside = insideSlots(nbh, x, y, h, w);
+  if ((similar.bits(idx) & inside) != inside)
+    return false;
+  uint32_t label = labels.get(idx);
+  bool interior = true;
+  nbh.forEach(x, y, [&](int, int, int nidx)
+  {
+    interior = labels.get(nidx) == label;
+    return interior;
+  });
+  return interior;
+}
+
+/**
+ * @brief Whether a pixel labeled from an interior coarse pixel, next to the band, is interior
+ *
+ * Its neighbours labeled from interior coarse pixels as well are similar to
+ * it by assumption; the others are band pixels, similar to it by their own
+ * masks. All of them must share its label.
+ */
+static bool isInteriorNextToBand(const SimilarityMap &similar, const Neighbourhood &nbh, const LabelMap &labels,
+                                 const std::vector<uint8_t> &coarseState, int cw, int idx, int h, int w)
+{
+  int x = idx / w, y = idx % w;
+  unsigned inside = insideSlots(nbh, x, y, h, w);
+  uint32_t label = labels.get(idx);
+  for (int k = 0; k < 8; k++)
+  {
+    if (!(inside & (1u << k)))
+      continue;
+    int nx = x + SLOT_DX[k], ny = y + SLOT_DY[k], nidx = nx * w + ny;
+    if (labels.get(nidx) != label)
+      return false;
+    bool band = coarseState[(nx / 2) * cw + ny / 2] != PIXEL_INTERIOR;
+    if (band && !(similar.bits(nidx) & (1u << Neighbourhood::opposite(k))))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Label a pyramid level from the labels of the level above
+ *
+ * @param level The image of the level
+ * @param thresh Distance threshold
+ * @param metric Distance between two pixels
+ * @param nbh Neighbourhood of the level
+ * @param coarse Labels of the level above, without marker
+ * @param coarseState `PixelState` of every pixel of the level above
+ * @param similar Receives the similarity masks of the band pixels of the level
+ * @param fine Label map of the level, all zeros, sized for every pixel
+ * @param fineState If not NULL, receives the `PixelState` of every pixel of the level
+ * @param frontier Empty FIFO frontier with room for every pixel of the level
+ * @param band Scratch for the band pixels
+ * @param seeds Scratch for the labels the band pixels are seeded with
+ *
+ * @return The number of labels, 1..n, in no particular order
+ *
+ * The pixels of an interior coarse pixel take its label, renumbered so that
+ * labels without any interior pixel at this level leave no gap, without a
+ * single color comparison. The similarity masks of the others, the band, are
+ * then computed, and the band is seeded in one pass from the interior pixels
+ * only, so that the breadth-first growth gives every band pixel to the region
+ * of the closest interior pixel it is similarly connected to.
+ *
+ * The level below gets the state of every pixel. A pixel of an interior
+ * coarse pixel is interior when the coarse pixels its neighbours come from
+ * are all interior, as its neighbours then all took the same label, or else
+ * when its band neighbours took its label and are similar to it. A band
+ * pixel is interior when its mask and the labels of its neighbours say so.
+ */
+static uint32_t refineLevel(const cv::Mat &level, double thresh, ColorMetric metric, const Neighbourhood &nbh,
+                            const LabelMap &coarse, const std::vector<uint8_t> &coarseState, SimilarityMap &similar,
+                            LabelMap &fine, std::vector<uint8_t> *fineState, Frontier &frontier,
+                            std::vector<uint32_t> &band, std::vector<uint32_t> &seeds)
+{
+  const int h = level.rows, w = level.cols;
+  const int ch = coarse.mat().rows, cw = coarse.mat().cols;
+  std::vector<uint32_t> ids(coarse.maxLabel() + 1, 0); // label at this level of every coarse label
+  uint32_t n = 0;
+  band.clear();
+
+  for (int x = 0; x < h; x++)
+  {
+    for (int y = 0; y < w; y++)
+    {
+      int idx = x * w + y, cidx = (x / 2) * cw + y / 2;
+      if (coarseState[cidx] == PIXEL_INTERIOR)
+      {
+        uint32_t c = coarse.get(cidx);
+        if (ids[c] == 0)
+          ids[c] = ++n;
+        fine.set(idx, ids[c]);
+      }
+      else
+        band.push_back(idx);
+    }
+  }
+  // a noisy level may be mostly band, which the pass over the whole level compares faster
+  if (band.size() * BAND_FULL_PASS > (size_t)h * w)
+    similar.compute(level, thresh, metric, nbh.size());
+  else
+    similar.computeAt(level, thresh, metric, nbh.size(), band);
+
+  // only interior pixels are labeled yet: seed the band pixels next to them
+  seeds.resize(band.size());
+  for (size_t i = 0; i < band.size(); i++)
+  {
+    uint32_t label = 0;
+    nbh.forEachIn(band[i] / w, band[i] % w, similar.bits(band[i]), [&](int, int, int nidx)
+    {
+      label = fine.get(nidx);
+      return label == 0;
+    });
+    seeds[i] = label;
+  }
+  for (size_t i = 0; i < band.size(); i++)
+  {
+    if (seeds[i] != 0)
+    {
+      fine.set(band[i], seeds[i]);
+      frontier.push(band[i]);
+    }
+  }
+  spread(similar, nbh, fine, frontier, w);
+
+  // the rest of the band is reached from no interior pixel
+  for (uint32_t idx : band)
+  {
+    if (fine.get(idx) == 0)
+    {
+      fine.set(idx, ++n);
+      frontier.push(idx);
+      spread(similar, nbh, fine, frontier, w);
+    }
+  }
+
+  if (fineState)
+  {
+    // the neighbours of a pixel come from its own coarse pixel and from the
+    // coarse pixels on the side of its position within it
+    fineState->assign((size_t)h * w, PIXEL_BAND);
+    const bool diagonals = nbh.size() == 8;
+    for (int x = 0; x < h; x++)
+    {
+      int cx = x / 2, nx = x % 2 ? cx + 1 : cx - 1;
+      bool rowInside = nx >= 0 && nx < ch && (x % 2 == 0 || x + 1 < h);
+      for (int y = 0; y < w; y++)
+      {
+        int cy = y / 2, ny = y % 2 ? cy + 1 : cy - 1;
+        bool colInside = ny >= 0 && ny < cw && (y % 2 == 0 || y + 1 < w);
+        if (coarseState[cx * cw + cy] != PIXEL_INTERIOR)
+          continue;
+        bool nextToBand = (rowInside && coarseState[nx * cw + cy] != PIXEL_INTERIOR) ||
+                          (colInside && coarseState[cx * cw + ny] != PIXEL_INTERIOR) ||
+                          (diagonals && rowInside && colInside && coarseState[nx * cw + ny] != PIXEL_INTERIOR);
+        if (!nextToBand || isInteriorNextToBand(similar, nbh, fine, coarseState, cw, x * w + y, h, w))
+          (*fineState)[x * w + y] = PIXEL_INTERIOR;
+      }
+    }
+    for (uint32_t idx : band)
+    {
+      if (isInterior(similar, nbh, fine, (int)idx, h, w))
+        (*fineState)[idx] = PIXEL_INTERIOR;
+    }
+  }
+  return n;
+}
+
+int growPyramid(const cv::Mat &im, const Neighbourhood &nbh, double thresh, ColorMetric metric, int levels,
+                LabelMap &labels, int min_region, SimilarityMap &similar, uint32_t *scratch)
+{
+  const int h = im.rows, w = im.cols;
+  if (h == 0 || w == 0)
+    return 0;
+
+  std::vector<cv::Mat> pyramid(1, im);
+  while ((int)pyramid.size() <= levels && pyramid.back().rows >= 2 && pyramid.back().cols >= 2)
+  {
+    cv::Mat down;
+    cv::pyrDown(pyramid.back(), down);
+    pyramid.push_back(down);
+  }
+
+  Frontier frontier; // every level has at most h * w pixels
+  if (scratch)
+    frontier.attach(scratch, (size_t)h * w);
+  else
+    frontier.reserve((size_t)h * w);
+  frontier.setOrder(ORDER_FIFO);
+
+  uint32_t n; // labels of the full resolution, before numbering
+  std::vector<size_t> sizes;
+  const int top = (int)pyramid.size() - 1;
+  if (top == 0)
+  {
+    similar.compute(im, thresh, metric, nbh.size());
+    scanLabelRows(similar, nbh, labels, 0, h, sizes);
+    n = (uint32_t)sizes.size();
+  }
+  else
+  {
+    // only the coarsest level is compared in full
+    const cv::Mat &coarsest = pyramid[top];
+    const int ch = coarsest.rows, cw = coarsest.cols;
+    SimilarityMap levelSimilar;
+    levelSimilar.compute(coarsest, thresh, metric, nbh.size());
+    Neighbourhood levelNbh(ch, cw, nbh.size());
+    LabelMap coarse(ch, cw, coarsest.total());
+    scanLabelRows(levelSimilar, levelNbh, coarse, 0, ch, sizes);
+    std::vector<uint8_t> state((size_t)ch * cw), fineState;
+    for (int idx = 0; idx < ch * cw; idx++)
+      state[idx] = isInterior(levelSimilar, levelNbh, coarse, idx, ch, cw) ? PIXEL_INTERIOR : PIXEL_BAND;
+
+    std::vector<uint32_t> band, seeds;
+    for (int l = top - 1; l > 0; l--)
+    {
+      const cv::Mat &level = pyramid[l];
+      LabelMap fine(level.rows, level.cols, level.total());
+      refineLevel(level, thresh, metric, Neighbourhood(level.rows, level.cols, nbh.size()), coarse, state,
+                  levelSimilar, fine, &fineState, frontier, band, seeds);
+      coarse = fine;
+      state.swap(fineState);
+    }
+    n = refineLevel(im, thresh, metric, nbh, coarse, state, similar, labels, NULL, frontier, band, seeds);
+  }
+  // number the regions by the raster order of their first pixel
+  std::vector<size_t> area(n + 1, 0);
+  for (int idx = 0; idx < h * w; idx++)
+    area[labels.get(idx)]++;
+  std::vector<uint32_t> final(n + 1, 0);
+  int regions = 0;
+  for (int idx = 0; idx < h * w; idx++)
+  {
+    uint32_t l = labels.get(idx);
+    if (final[l] == 0)
+      final[l] = area[l] >= (size_t)min_region ? ++regions : labels.maxLabel();
+    labels.set(idx, final[l]);
+  }
+  return regions;
+}
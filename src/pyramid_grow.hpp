@@ -0,0 +1,54 @@
+#ifndef PYRAMID_GROW_HPP
+#define PYRAMID_GROW_HPP
+
+#include <opencv2/opencv.hpp>
+#include "label_map.hpp"
+#include "neighbourhood.hpp"
+#include "similarity_map.hpp"
+
+/**
+ * @brief Label the regions of an image coarse to fine over a Gaussian pyramid
+ *
+ * @param im The image, of a type `SimilarityMap::supports()`
+ * @param nbh Neighbourhood of the image, of the connectivity to label with
+ * @param thresh Distance threshold: neighbours closer than this are similar
+ * @param metric Distance between two pixels
+ * @param levels Number of coarser levels, each half the size of the previous one
+ * @param labels Label map of the image, all zeros, sized for h * w regions
+ * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+ * @param similar Similarity map of the image size, receives the masks of the
+ * pixels grown again at full resolution (of all of them with 0 levels); those
+ * of the other pixels are undefined
+ * @param scratch Room for h * w pixel indices for the frontier, or NULL to allocate them
+ *
+ * @return The number of regions
+ *
+ * The image is reduced with `cv::pyrDown`, and only the coarsest level is
+ * compared in full: its similarity masks are computed and it is labeled with
+ * `scanLabelRows`. A pixel of a level is interior when it is similar to all
+ * its neighbours and they share its label. Every finer level then starts from
+ * the level above: the pixels of an interior coarse pixel take its label
+ * without any color comparison, and the similarity masks are computed for the
+ * other pixels only, the band along the region boundaries, which are cleared
+ * and grown again breadth-first from the interior pixels; band pixels reached
+ * from no interior pixel start new regions. The colors of the uniform regions
+ * are thus compared at the coarsest level only, and the work of the finer
+ * levels is proportional to the length of the boundaries rather than to the
+ * area of the image. This pays off on regions much larger than 2^levels
+ * pixels across; on smaller ones the band covers most of every level, whose
+ * masks are then computed in one pass as by the other engines, and the
+ * pyramid only adds to their cost.
+ *
+ * The regions are numbered by the raster order of their first pixel and the
+ * regions smaller than `min_region` are labeled `labels.maxLabel()`, as with
+ * the other engines, but the regions themselves are an approximation: two
+ * parts of a region the coarse levels labeled apart stay apart, a coarse
+ * region the full resolution would split is only split along its band, and
+ * an edge inside a region that `cv::pyrDown` smoothed below the threshold at
+ * every coarser level is not seen at all. With 0 levels, the labels are those
+ * of the serial scan.
+ */
+int growPyramid(const cv::Mat &im, const Neighbourhood &nbh, double thresh, ColorMetric metric, int levels,
+                LabelMap &labels, int min_region, SimilarityMap &similar, uint32_t *scratch = NULL);
+
+#endif
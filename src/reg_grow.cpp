@@ -1,293 +1,353 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <opencv2/opencv.hpp>
-#include <math.h>
-#include <time.h>
+#include <filesystem>
+#include "affinity.hpp"
+#include "batch.hpp"
+#include "label_io.hpp"
+#include "reggrow.hpp"
+#include "spool.hpp"
+#include "strip_stream.hpp"
 
 using namespace cv;
 
-// stack of pixel coordinates during the region-growing process
-typedef struct Stack
-{
-  int *x;
-  int *y;
-  int size;
-  int capacity;
-} Stack;
-
 /**
- * @brief Initialize a stack
+ * @brief Save a segmented image
  *
- * @param stack pointer to a stack
- * @param capacity capacity of the stack
- *
- * Initializes a stack with given capacity.
- */
-void initStack(Stack *stack, int capacity)
-{
-  stack->x = (int *)malloc(capacity * sizeof(int));
-  stack->y = (int *)malloc(capacity * sizeof(int));
-  stack->size = 0;
-  stack->capacity = capacity;
-}
-
-/**
- * @brief Pushes values to stack
+ * @param path Path of the output file
+ * @param segs The segmented image
  *
- * @param stack pointer to a stack
- * @param x_coord x coordinate to push
- * @param y_coord y coordinate to push
+ * @return True if the image was written
  *
- * Pushes an (x_coord, y_coord) pair to the stack. If the stack is full, it
- * expands the capacity.
+ * The segmented image is only a visualization, encoded in the format of the
+ * extension of the path; JPEG files use a quality of 95. Use `writeLabels()`
+ * to keep the labels themselves.
  */
-void push(Stack *stack, int x_coord, int y_coord)
+bool saveSegmented(const std::string &path, const Mat &segs)
 {
-  if (stack->size == stack->capacity)
-  {
-    stack->capacity *= 2; // double the capacity if the stack is full
-    stack->x = (int *)realloc(stack->x, stack->capacity * sizeof(int));
-    stack->y = (int *)realloc(stack->y, stack->capacity * sizeof(int));
-  }
-  stack->x[stack->size] = x_coord;
-  stack->y[stack->size] = y_coord;
-  stack->size++;
+  return imwrite(path, segs, {IMWRITE_JPEG_QUALITY, 95});
 }
 
 /**
- * @brief Pops a value from the stack
+ * @brief Parse the threshold argument, one threshold or a comma-separated list of them
  *
- * @param stack Pointer to the stack
- * @param x_coord Pointer to store the popped x value
- * @param y_coord Pointer to store the popped y value
+ * @param list The argument
+ * @param thresholds Receives the thresholds
  *
- * Pops a value from the stack and stores it in x_coord and y_coord. If the stack is empty,
- * does nothing.
+ * @return False if the list is empty or holds something other than a number
  */
-void pop(Stack *stack, int *x_coord, int *y_coord)
+bool parseThresholds(const char *list, std::vector<float> &thresholds)
 {
-  if (stack->size > 0)
-  {
-    stack->size--;
-    *x_coord = stack->x[stack->size];
-    *y_coord = stack->y[stack->size];
-  }
-  else
+  thresholds.clear();
+  for (const char *p = list;; p++)
   {
-    fprintf(stderr, "Stack is empty\n");
+    char *end;
+    thresholds.push_back(strtof(p, &end));
+    if (end == p || (*end != ',' && *end != '\0'))
+      return false;
+    p = end;
+    if (*p == '\0')
+      return true;
   }
 }
 
 /**
- * @brief Check if the stack is empty
+ * @brief Path of the output of one threshold of a sweep
  *
- * @param stack Pointer to the stack
- * @return 1 if the stack is empty, 0 otherwise
+ * @param path The output path
+ * @param threshold The threshold
  *
- * Returns 1 if the stack is empty, 0 otherwise.
+ * @return The path with "-<threshold>" inserted before its extension
  */
-int isEmpty(Stack *stack)
+std::string sweepPath(const std::string &path, float threshold)
 {
-  return stack->size == 0;
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "-%g", threshold);
+  size_t dot = path.find_last_of('.'), slash = path.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + suffix;
+  return path.substr(0, dot) + suffix + path.substr(dot);
 }
 
 /**
- * @brief Free the memory allocated for stack
+ * @brief Open the file receiving the stats lines
  *
- * @param stack Pointer to the stack
+ * @param path Path of the file, appended to, or "-" for the standard output
  *
- * Frees the memory allocated for the stack.
+ * @return The file, or NULL if it cannot be opened
  */
-void freeStack(Stack *stack)
+FILE *openStats(const char *path)
 {
-  free(stack->x);
-  free(stack->y);
+  return strcmp(path, "-") == 0 ? stdout : fopen(path, "a");
 }
 
-typedef struct RegionGrow
-{
-  Mat im;            // original image
-  int h, w;          // height and width
-  double *passedBy;  // which pixels have already been processed
-  int currentRegion; // current region number
-  int iterations;
-  Mat SEGS;     // stores the segmented image
-  Stack stack;  // stack of pixel coordinates
-  float thresh; // threshold
-} RegionGrow;
-
 /**
- * @brief Initialize a RegionGrow object
+ * @brief Segment images without any display
  *
- * @param rg Pointer to a RegionGrow object to initialize
- * @param img_path Path to the image to process
- * @param th Threshold value for region growing
+ * @param inputs Paths of the images, unless they come from a spool
+ * @param spool Spool the images are claimed from, and their results recorded
+ * in, or NULL
+ * @param out_dir Directory receiving <image name>.jpg for every image, or its label file
+ * @param params The segmentation parameters
+ * @param labels Whether to write the labels instead of the segmented image
+ * @param format Format of the label files
+ * @param run_stats File receiving the stats line of every image, or NULL
  *
- * Initializes a RegionGrow object with the given image path and threshold.
- * It reads the image, sets the height and width of the image, allocates memory
- * for the passedBy array, initializes the currentRegion and iterations to 0,
- * initializes the SEGS Mat to zeros, initializes the stack with a capacity of
- * 1000, and sets the threshold.
- */
-void initRegionGrow(RegionGrow *rg, const char *img_path, float th)
-{
-  rg->im = imread(img_path, IMREAD_COLOR);
-  rg->h = rg->im.rows;
-  rg->w = rg->im.cols;
-  rg->passedBy = (double *)calloc(rg->h * rg->w, sizeof(double)); // allocates memory for the passedBy array
-  rg->currentRegion = 0;
-  rg->iterations = 0;
-  rg->SEGS = Mat::zeros(rg->h, rg->w, CV_8UC3); // initializes the SEGS Mat to zeros
-  initStack(&rg->stack, 1000);                  // TODO: which is the right capacity?
-  rg->thresh = th;
-}
-
-/**
- * @brief Free the memory allocated for RegionGrow object
+ * @return The number of images that failed
  *
- * @param rg Pointer to the RegionGrow object
- *
- * Frees the memory allocated for the passedBy array and the stack.
+ * Images are decoded, segmented and encoded by the overlapped stages of
+ * `runBatch`. A single Segmenter segments every image, so that images of
+ * the same size reuse its buffers. With `labels`, every image gives
+ * <image name> with the extension of the label format, and is never colorized.
+ * The stats lines hold the phases of the segmentation stage only, since
+ * images are decoded and encoded on other threads meanwhile.
  */
-void freeRegionGrow(RegionGrow *rg)
+int segmentImages(const std::vector<std::string> &inputs, Spool *spool, const char *out_dir,
+                  const SegmentParams &params, bool labels, LabelFormat format, FILE *run_stats)
 {
-  free(rg->passedBy);
-  freeStack(&rg->stack);
+  Segmenter segmenter(params);
+  size_t next = 0;
+  return runBatch(
+      [&](std::string &path)
+      {
+        if (spool)
+          return spool->claim(path);
+        if (next == inputs.size())
+          return false;
+        path = inputs[next++];
+        return true;
+      },
+      [&](const std::string &input, const Mat &im)
+      {
+        const LabelMap &map = segmenter.segment(im);
+        if (segmenter.truncated())
+          fprintf(stderr, "Ran out of budget on %s, unreached pixels are left unlabeled\n", input.c_str());
+        // the encoder still holds the previous results, hand it a copy
+        Mat result = labels ? exportLabels(map) : segmenter.colorize().clone();
+        if (run_stats)
+          segmenter.stats().write(run_stats, input.c_str(), im.cols, im.rows, segmenter.regions());
+        if (spool)
+          spool->record(input, segmenter.regions(), segmenter.stats().totalMs());
+        return result;
+      },
+      [&](const std::string &input, const Mat &result)
+      {
+        if (labels)
+          return writeLabels(outputPath(input, out_dir, labelExtension(format)), result, format);
+        return saveSegmented(outputPath(input, out_dir, ".jpg"), result);
+      },
+      [&](const std::string &input, bool ok)
+      {
+        if (spool && !spool->complete(input, ok))
+          fprintf(stderr, "Could not record the completion of %s\n", input.c_str());
+      });
 }
 
 /**
- * @brief Check if the given coordinates are within the boundaries of the
- * image.
+ * @brief Segment a batch of images without any display
  *
- * @param rg Pointer to a RegionGrow object
- * @param x The x-coordinate to check
- * @param y The y-coordinate to check
+ * @param source Directory of images, or text file listing one image path per line
+ * @param out_dir Directory receiving the results, see `segmentImages`
+ * @param params The segmentation parameters
+ * @param labels Whether to write the labels instead of the segmented image
+ * @param format Format of the label files
+ * @param run_stats File receiving the stats line of every image, or NULL
  *
- * @return True if the coordinates are within the image boundaries, false
- * otherwise.
+ * @return 0 if every image was segmented and saved, 1 otherwise
  */
-int boundaries(RegionGrow *rg, int x, int y)
+int segmentBatch(const char *source, const char *out_dir, const SegmentParams &params, bool labels,
+                 LabelFormat format, FILE *run_stats)
 {
-  return x >= 0 && x < rg->h && y >= 0 && y < rg->w;
+  std::vector<std::string> inputs = listImages(source);
+  if (inputs.empty())
+  {
+    fprintf(stderr, "No image found in %s\n", source);
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(out_dir, ec);
+
+  int failures = segmentImages(inputs, NULL, out_dir, params, labels, format, run_stats);
+  printf("Segmented %d of %zu images into %s\n", (int)inputs.size() - failures, inputs.size(), out_dir);
+  return failures == 0 ? 0 : 1;
 }
 
 /**
- * @brief Calculate the Euclidean distance between two 3-channel color
- * pixels.
+ * @brief Segment the images of a spool shared with other processes, without any display
  *
- * @param a The first color pixel
- * @param b The second color pixel
+ * @param spool_dir The spool directory, see `Spool`
+ * @param source Images of a new spool: directory of images, or text file
+ * listing one image path per line
+ * @param out_dir Directory receiving the results, see `segmentImages`
+ * @param params The segmentation parameters
+ * @param labels Whether to write the labels instead of the segmented image
+ * @param format Format of the label files
+ * @param run_stats File receiving the stats line of every image, or NULL
+ * @param workers Number of worker processes
  *
- * @return The Euclidean distance between the two color pixels
+ * @return 0 if every image of the spool has been segmented and saved, by
+ * this run or another, 1 otherwise
  *
- * This function calculates the Euclidean distance between two 3-channel color
- * pixels. It compares the RGB values of each pixel and calculates the
- * Euclidean distance between them. The function uses the formula
- * sqrt((a_R - b_R)^2 + (a_G - b_G)^2 + (a_B - b_B)^2), where a_R, a_G, and
- * a_B are the RGB values of pixel a, and b_R, b_G, and b_B are the RGB values
- * of pixel b.
+ * With one worker, this process claims and segments images itself.
+ * Otherwise it forks the workers, before any thread is started, pins each
+ * one to the CPUs of a NUMA node in turn, and waits for them. A worker pays
+ * the process startup and the OpenCV initialization once, and then
+ * segments the images it claims through the pipeline of `segmentImages`.
+ * The summary of the manifest, which covers the images completed by other
+ * processes and earlier runs too, is then printed as a JSON line.
  */
-double distance(Vec3b a, Vec3b b)
+int segmentSpool(const char *spool_dir, const char *source, const char *out_dir, const SegmentParams &params,
+                 bool labels, LabelFormat format, FILE *run_stats, int workers)
 {
-  double dist = 0;
-  for (int i = 0; i < 3; i++)
+  Spool spool;
+  if (!spool.open(spool_dir, source))
   {
-    dist += pow(a[i] - b[i], 2);
+    fprintf(stderr, "Could not open spool %s\n", spool_dir);
+    return 1;
   }
-  return sqrt(dist);
-}
-
-/**
- * @brief Perform a breadth-first search on a RegionGrow object starting from
- * the given coordinates.
- *
- * @param rg Pointer to a RegionGrow object
- * @param x0 The x-coordinate of the starting point
- * @param y0 The y-coordinate of the starting point
- *
- * This function performs a breadth-first search on a RegionGrow object starting
- * from the given coordinates. It initializes the variable `var` with the
- * threshold of the RegionGrow object, and sets the `regionNum` to the value of
- * the passedBy array at the starting point. It then enters a loop until the
- * stack is empty. In each iteration, it pops a coordinate from the stack and
- * increments the `iterations` counter. It then checks the neighbors of the
- * current coordinate and adds them to the stack if they are within the image
- * boundaries and have not been passed by before. If the distance between the
- * current coordinate and its neighbor is less than `var`, it sets the passedBy
- * value of the neighbor to `regionNum` and adds it to the stack.
- */
-void BFS(RegionGrow *rg, int x0, int y0)
-{
-  int x, y;
-  double var = rg->thresh;
-  double regionNum = rg->passedBy[x0 * rg->w + y0];
-
-  while (!isEmpty(&rg->stack))
+  if (spool.size() == 0)
   {
-    pop(&rg->stack, &x, &y);
-    rg->iterations++;
+    fprintf(stderr, "No image found in %s\n", source);
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(out_dir, ec);
 
-    for (int i = -1; i <= 1; i++)
+  std::vector<pid_t> pids;
+  if (workers > 1)
+  {
+    std::vector<std::vector<int>> nodes = numaNodeCpus();
+    fflush(stdout);
+    if (run_stats)
+      fflush(run_stats);
+    for (int w = 0; w < workers; w++)
     {
-      for (int j = -1; j <= 1; j++)
+      pid_t pid = fork();
+      if (pid < 0)
       {
-        if (i == 0 && j == 0) // centre pixel
-          continue;
-        int nx = x + i, ny = y + j;
-        if (boundaries(rg, nx, ny) && rg->passedBy[nx * rg->w + ny] == 0)
+        perror("fork");
+        break;
+      }
+      if (pid == 0)
+      {
+        if (!nodes.empty())
+          pinToCpus(nodes[w % nodes.size()]);
+        int failures;
         {
-          if (distance(rg->im.at<Vec3b>(x, y), rg->im.at<Vec3b>(nx, ny)) < var)
-          {
-            rg->passedBy[nx * rg->w + ny] = regionNum;
-            push(&rg->stack, nx, ny); // add neighbor to stack
-          }
+          Spool own; // claims are locks of open files, which must not be shared with the other workers
+          failures = own.open(spool_dir, source)
+                         ? segmentImages(std::vector<std::string>(), &own, out_dir, params, labels, format, run_stats)
+                         : 1;
         }
+        fflush(stdout);
+        _exit(failures == 0 ? 0 : 1);
       }
+      pids.push_back(pid);
     }
   }
+  if (pids.empty())
+    segmentImages(std::vector<std::string>(), &spool, out_dir, params, labels, format, run_stats);
+  for (pid_t pid : pids)
+  {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+    if (!WIFEXITED(status))
+      fprintf(stderr, "Worker %d died, its unfinished images are left to the next run\n", (int)pid);
+  }
+
+  SpoolSummary summary = spool.summary();
+  summary.write(stdout);
+  printf("Segmented %zu of %zu images into %s\n", summary.done - summary.failed, summary.images, out_dir);
+  return summary.done == summary.images && summary.failed == 0 ? 0 : 1;
 }
 
 /**
- * @brief Apply region growing algorithm to image
+ * @brief Segment a mapped PPM image strip by strip, without any display
+ *
+ * @param input Path of the binary PPM image
+ * @param output Path of the label file
+ * @param params The segmentation parameters, of which only the threshold and
+ * the minimum region size apply
+ * @param strip_rows Number of rows of a strip
+ * @param format Format of the label file, raw or RLE
+ * @param run_stats File receiving the stats line of the image, or NULL
  *
- * @param rg Pointer to a RegionGrow object
+ * @return 0 if the labels were written, -1 otherwise
  *
- * This function applies the region growing algorithm to the image stored in the
- * RegionGrow object. It initializes the currentRegion to 0 and iterates over
- * each pixel in the image. For each unprocessed pixel, it sets the currentRegion
- * to the next region number, sets the passedBy value of the pixel to the currentRegion
- * number, pushes the pixel to the stack, and calls the BFS function. After iterating
- * over all pixels, it sets the colors of each pixel based on its passedBy value,
- * displays the segmented image, and waits for a key press.
+ * The labeling passes read and write as they go, so the stats line times
+ * them all as the label phase.
  */
-void ApplyRegionGrow(RegionGrow *rg)
+int segmentStream(const char *input, const std::string &output, const SegmentParams &params, int strip_rows,
+                  LabelFormat format, FILE *run_stats)
 {
-  for (int x0 = 0; x0 < rg->h; x0++)
+  if (format == LABELS_PNG16)
   {
-    for (int y0 = 0; y0 < rg->w; y0++)
-    {
-      if (rg->passedBy[x0 * rg->w + y0] == 0)
-      {
-        rg->currentRegion++;
-        rg->passedBy[x0 * rg->w + y0] = rg->currentRegion;
-        push(&rg->stack, x0, y0);
-        BFS(rg, x0, y0);
-      }
-    }
+    fprintf(stderr, "Streamed labels are written as raw or rle files\n");
+    return -1;
   }
-
-  for (int i = 0; i < rg->h; i++)
+  MappedImage im;
+  if (!im.open(input))
   {
-    for (int j = 0; j < rg->w; j++)
-    {
-      double val = rg->passedBy[i * rg->w + j];
-      rg->SEGS.at<Vec3b>(i, j) = val == 0 ? Vec3b(255, 255, 255) : Vec3b(val * 35, val * 90, val * 30);
-    }
+    fprintf(stderr, "Could not map binary PPM image %s\n", input);
+    return -1;
+  }
+  RunStats stats;
+  int regions;
+  {
+    PhaseTimer timer(stats, PHASE_LABEL);
+    regions = streamRegionGrow(im, params.threshold, params.minRegion, strip_rows, output, format);
   }
-  // save segmented image with high quality >=1000 dpi
-  imwrite("../images/segmented.jpg", rg->SEGS, {IMWRITE_JPEG_QUALITY, 1000});
-  imshow("Region Growing", rg->SEGS);
-  waitKey(0);
+  if (regions < 0)
+  {
+    fprintf(stderr, "Could not write %s\n", output.c_str());
+    return -1;
+  }
+  printf("%d regions written to %s\n", regions, output.c_str());
+  if (run_stats)
+    stats.write(run_stats, input, im.cols(), im.rows(), regions);
+  return 0;
+}
+
+/**
+ * @brief Print the command line usage
+ *
+ * @param prog Name of the program
+ */
+void usage(const char *prog)
+{
+  printf("Usage: %s [-m min_region] [-r min_area] [-j threads] [-e flood|scan|pyramid|opencl] [-P levels] "
+         "[-c 4|8] [-d l2|l1|linf] [-C bgr|lab|lab8] "
+         "[-o output] [-l raw|png|rle] [-s stats] "
+         "[-S rows] [-T stats] [-D ms] [-B pixels] [-n] [-b] [-I tolerance] [-Q spool] [-w workers] "
+         "<image_path> <threshold[,threshold...]>\n",
+         prog);
+  printf("  -m  reject regions with fewer pixels (default 0, keep all)\n");
+  printf("  -r  merge regions with fewer pixels into their most similar neighbour (default 0, keep all)\n");
+  printf("  -j  label parallel tiles on that many threads (default 1, serial)\n");
+  printf("  -e  flood fill, two-pass scanline union-find, coarse to fine pyramid or OpenCL label propagation "
+         "(default flood)\n");
+  printf("  -P  coarser levels of the pyramid engine (default 3)\n");
+  printf("  -c  connectivity of the regions (default 8)\n");
+  printf("  -d  distance between two pixels: Euclidean, sum or largest of the channel differences (default l2)\n");
+  printf("  -C  color space the distances are computed in: as read, float CIELab or 8-bit CIELab (default bgr)\n");
+  printf("  -o  output file (default ../images/segmented.jpg), or output directory with -b (default .)\n");
+  printf("  -l  write the labels losslessly in that format to the output instead of the segmented image\n");
+  printf("  -s  write the regions, their statistics and neighbours to a CSV file\n");
+  printf("  -S  label a binary PPM image in strips of that many rows, writing its labels (default raw) without display\n");
+  printf("  -T  append a JSON line of counters and phase times per image to a file, - for the standard output\n");
+  printf("  -D  stop the flood fill after that many milliseconds, above 0, leaving the rest unlabeled (default none)\n");
+  printf("  -B  stop the flood fill after visiting that many pixels, at least 1, leaving the rest unlabeled (default none)\n");
+  printf("  -n  do not display the segmented image\n");
+  printf("  -b  <image_path> is a directory or a list of images, segmented without display\n");
+  printf("  -I  with -b, grow again only the regions of the pixels that moved past that color distance from the previous "
+         "image, for the frames of a sequence\n");
+  printf("  -Q  with -b, share the images with other processes through that spool directory, resuming it if it exists\n");
+  printf("  -w  with -Q, segment on that many worker processes, pinned to the NUMA nodes in turn (default 1)\n");
 }
 
 /**
@@ -298,22 +358,241 @@ void ApplyRegionGrow(RegionGrow *rg)
  *
  * @return 0 upon successful completion
  *
- * This function checks if the number of command line arguments is 3. If it is not, it prints the usage message and returns -1.
- * If the number of arguments is 3, it initializes a RegionGrow object with the given image path and threshold.
- * It then applies the region growing algorithm to the image, frees the memory allocated for the RegionGrow object, and returns 0.
+ * This function parses the options and checks that the image path and threshold are given. If not, it prints the usage
+ * message and returns -1. In batch mode, it segments every image of the batch with `segmentBatch`, or, with a spool
+ * (`-Q`), the images it claims from the spool with `segmentSpool`. In streaming mode
+ * (`-S`), it labels a mapped PPM image strip by strip with `segmentStream`. Otherwise, it reads
+ * the image and segments it with a libreggrow Segmenter, given the threshold, minimum region size, merge size, number of
+ * threads, engine, distance, color space and budget. With a comma-separated list of thresholds, the image is segmented
+ * with each of them in turn, converted to the color space and labeled from a MergeTree built once, and every output path gets "-<threshold>" before its
+ * extension. For each threshold, it then saves the segmented image, or the labels in the label format given by `-l` (the image is then
+ * only colorized for display), writes the region adjacency graph and the stats line if asked to, displays the segmented image unless
+ * disabled, and returns 0. It returns -1 if the output cannot be written.
  */
 int main(int argc, char **argv)
 {
-  if (argc != 3)
+  SegmentParams params;
+  const char *output = NULL, *stats = NULL, *run_stats_path = NULL, *spool_dir = NULL;
+  bool display = true, batch = false, labels = false;
+  LabelFormat format = LABELS_RAW;
+  int opt, strip_rows = 0, workers = 1;
+  while ((opt = getopt(argc, argv, "m:r:j:e:P:c:d:C:o:l:s:S:T:D:B:I:Q:w:nb")) != -1)
   {
-    printf("Usage: %s <image_path> <threshold>\n", argv[0]);
+    switch (opt)
+    {
+    case 'm':
+      params.minRegion = atoi(optarg);
+      break;
+    case 'r':
+      params.mergeBelow = atoi(optarg);
+      break;
+    case 'j':
+      params.threads = atoi(optarg);
+      break;
+    case 'e':
+      if (strcmp(optarg, "flood") == 0)
+        params.engine = ENGINE_FLOOD;
+      else if (strcmp(optarg, "scan") == 0)
+        params.engine = ENGINE_SCAN;
+      else if (strcmp(optarg, "pyramid") == 0)
+        params.engine = ENGINE_PYRAMID;
+      else if (strcmp(optarg, "opencl") == 0)
+        params.engine = ENGINE_OPENCL;
+      else
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'P':
+      params.pyramidLevels = atoi(optarg);
+      break;
+    case 'c':
+      params.connectivity = atoi(optarg);
+      if (params.connectivity != 4 && params.connectivity != 8)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'C':
+      if (!colorSpaceFromName(optarg, params.colorSpace))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'd':
+      if (strcmp(optarg, "l2") == 0)
+        params.metric = METRIC_L2;
+      else if (strcmp(optarg, "l1") == 0)
+        params.metric = METRIC_L1;
+      else if (strcmp(optarg, "linf") == 0)
+        params.metric = METRIC_CHEBYSHEV;
+      else
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'l':
+      if (!labelFormatFromName(optarg, format))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      labels = true;
+      break;
+    case 's':
+      stats = optarg;
+      break;
+    case 'S':
+      strip_rows = atoi(optarg);
+      if (strip_rows <= 0)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'T':
+      run_stats_path = optarg;
+      break;
+    case 'D':
+      if (!params.budget.parseDeadline(optarg))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'B':
+      if (!params.budget.parseMaxPixels(optarg))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'I':
+      params.incremental = atof(optarg);
+      if (params.incremental < 0)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'Q':
+      spool_dir = optarg;
+      break;
+    case 'w':
+      workers = atoi(optarg);
+      if (workers < 1)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'n':
+      display = false;
+      break;
+    case 'b':
+      batch = true;
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (argc - optind != 2 || (spool_dir && !batch) || (workers > 1 && !spool_dir) || (params.incremental >= 0 && !batch))
+  {
+    usage(argv[0]);
     return -1;
   }
 
-  RegionGrow rg;
-  initRegionGrow(&rg, argv[1], atof(argv[2]));
-  ApplyRegionGrow(&rg);
-  freeRegionGrow(&rg);
+  std::vector<float> thresholds;
+  if (!parseThresholds(argv[optind + 1], thresholds) || (thresholds.size() > 1 && (batch || strip_rows > 0)))
+  {
+    usage(argv[0]);
+    return -1;
+  }
+  params.threshold = thresholds[0];
+  FILE *run_stats = NULL;
+  if (run_stats_path && !(run_stats = openStats(run_stats_path)))
+  {
+    fprintf(stderr, "Could not open %s\n", run_stats_path);
+    return -1;
+  }
+  if (batch && spool_dir)
+    return segmentSpool(spool_dir, argv[optind], output ? output : ".", params, labels, format, run_stats, workers);
+  if (batch)
+    return segmentBatch(argv[optind], output ? output : ".", params, labels, format, run_stats);
+  if (strip_rows > 0)
+    return segmentStream(argv[optind], output ? output : std::string("../images/segmented") + labelExtension(format),
+                         params, strip_rows, format, run_stats);
 
-  return 0;
+  RunStats io; // phases outside of the Segmenter
+  Mat im;
+  {
+    PhaseTimer timer(io, PHASE_LOAD);
+    im = imread(argv[optind], IMREAD_ANYDEPTH | IMREAD_ANYCOLOR);
+  }
+  if (im.empty())
+  {
+    fprintf(stderr, "Could not read image %s\n", argv[optind]);
+    return -1;
+  }
+  if (!SimilarityMap::supports(im.type()))
+  {
+    fprintf(stderr, "Unsupported pixel type of %s\n", argv[optind]);
+    return -1;
+  }
+
+  // a sweep segments the same image with every threshold, converting it to
+  // the color space and sorting its neighbour pairs only once
+  params.sweep = thresholds.size() > 1;
+  Segmenter segmenter(params);
+  bool saved = true;
+  for (float threshold : thresholds)
+  {
+    params.threshold = threshold;
+    segmenter.setParams(params);
+    const LabelMap &map = segmenter.segment(im);
+    if (segmenter.truncated())
+      fprintf(stderr, "Ran out of budget, unreached pixels are left unlabeled\n");
+    std::string path = output ? output : std::string("../images/segmented") + (labels ? labelExtension(format) : ".jpg");
+    std::string csv = stats ? stats : "";
+    if (thresholds.size() > 1)
+    {
+      path = sweepPath(path, threshold);
+      csv = stats ? sweepPath(csv, threshold) : csv;
+    }
+    Mat segs; // the colorized image, only needed for display with -l
+    if (!labels || display)
+      segs = segmenter.colorize();
+    bool written;
+    {
+      PhaseTimer timer(io, PHASE_SAVE);
+      written = labels ? writeLabels(path, exportLabels(map), format) : saveSegmented(path, segs);
+    }
+    if (!written)
+      fprintf(stderr, "Could not write %s\n", path.c_str());
+    saved = saved && written;
+    if (stats && !segmenter.graph().writeCsv(csv))
+      fprintf(stderr, "Could not write %s\n", csv.c_str());
+    if (run_stats)
+    {
+      RunStats run = segmenter.stats();
+      run.add(io);
+      run.write(run_stats, argv[optind], im.cols, im.rows, segmenter.regions());
+    }
+    io.reset(); // the image is loaded once
+    if (display)
+    {
+      imshow("Region Growing", segs);
+      waitKey(0);
+    }
+  }
+
+  return saved ? 0 : -1;
 }
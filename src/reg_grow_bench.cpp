@@ -0,0 +1,752 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "neighbourhood.hpp"
+#include "reggrow.hpp"
+
+using namespace cv;
+
+// a labeling configuration to benchmark
+typedef struct BenchEngine
+{
+  const char *name;
+  LabelEngine engine;
+  int threads;
+  FrontierOrder order; // of the flood fill
+} BenchEngine;
+
+// timings and results of one run
+typedef struct BenchResult
+{
+  double load_ms, label_ms, colorize_ms, encode_ms;
+  long peak_rss_kb; // of the process during the run
+  long run_rss_kb;  // peak during the run above the resident size at its start
+  int regions;
+  int iterations;
+} BenchResult;
+
+/**
+ * @brief Parse a comma separated list of numbers
+ *
+ * @param list The list, e.g. "1,4,12"
+ *
+ * @return The numbers of the list
+ */
+std::vector<double> parseList(const char *list)
+{
+  std::vector<double> values;
+  const char *p = list;
+  while (*p)
+  {
+    char *end;
+    values.push_back(strtod(p, &end));
+    if (end == p)
+      break;
+    p = *end == ',' ? end + 1 : end;
+  }
+  return values;
+}
+
+/**
+ * @brief Generate a synthetic image made of square cells of random colors
+ *
+ * @param h Height of the image
+ * @param w Width of the image
+ * @param cell Side of the cells in pixels, which sets the region density
+ *
+ * @return A CV_8UC3 image
+ *
+ * Each cell has a uniform random color plus a deterministic per-pixel noise
+ * of at most 4 per channel, so that low thresholds over-segment the cells and
+ * higher ones merge neighbouring cells of close colors. The image only
+ * depends on its arguments.
+ */
+Mat synthImage(int h, int w, int cell)
+{
+  RNG rng(0x5eed + cell);
+  int rows = (h + cell - 1) / cell, cols = (w + cell - 1) / cell;
+  std::vector<Vec3b> colors(rows * cols);
+  for (Vec3b &c : colors)
+    c = Vec3b((uchar)rng.uniform(0, 251), (uchar)rng.uniform(0, 251), (uchar)rng.uniform(0, 251));
+
+  Mat im(h, w, CV_8UC3);
+  for (int x = 0; x < h; x++)
+  {
+    Vec3b *row = im.ptr<Vec3b>(x);
+    const Vec3b *cellColors = &colors[(x / cell) * cols];
+    for (int y = 0; y < w; y++)
+    {
+      unsigned noise = (unsigned)(x * 73856093) ^ (unsigned)(y * 19349663);
+      Vec3b c = cellColors[y / cell];
+      row[y] = Vec3b(c[0] + (noise & 3), c[1] + ((noise >> 2) & 3), c[2] + ((noise >> 4) & 3));
+    }
+  }
+  return im;
+}
+
+/**
+ * @brief Milliseconds elapsed since a time point
+ */
+double elapsedMs(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/**
+ * @brief Reset the peak resident set size of the process to its current size
+ *
+ * @return False where the kernel cannot, before Linux 4.0 or on other
+ * systems; the peak is then that of the whole process so far
+ */
+bool resetPeakRss()
+{
+#ifdef __GLIBC__
+  malloc_trim(0); // give the heap freed by the previous runs back, or it would be reused unseen
+#endif
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if (!f)
+    return false;
+  bool written = fputs("5", f) >= 0;
+  return fclose(f) == 0 && written;
+}
+
+/**
+ * @brief A size of /proc/self/status, such as "VmHWM" or "VmRSS", in kilobytes
+ *
+ * @return The size, or -1 if it cannot be read
+ */
+long statusKb(const char *field)
+{
+  FILE *f = fopen("/proc/self/status", "r");
+  if (!f)
+    return -1;
+  char line[256];
+  long kb = -1;
+  size_t len = strlen(field);
+  while (fgets(line, sizeof(line), f))
+  {
+    if (strncmp(line, field, len) == 0 && line[len] == ':')
+    {
+      kb = atol(line + len + 1);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+/**
+ * @brief Peak resident set size of the process since the last `resetPeakRss()`, in kilobytes
+ */
+long peakRssKb()
+{
+  long kb = statusKb("VmHWM");
+  if (kb >= 0)
+    return kb;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * @brief Run and time one segmentation
+ *
+ * @param encoded The input image, PNG encoded
+ * @param thresh Threshold value for region growing
+ * @param engine The labeling configuration
+ *
+ * @return The timings of the load (decode), label (including the
+ * initialization of the RegionGrow object), colorize and encode (JPEG, in
+ * memory) phases, the peak RSS of the run and the number of regions.
+ *
+ * The peak RSS of the process is reset before the run, so that it is that
+ * of this run alone and not of the largest run so far; `run_rss_kb` is the
+ * part of it above the resident size at the start of the run, the memory
+ * the run itself needed.
+ */
+BenchResult runOnce(const std::vector<uchar> &encoded, double thresh, const BenchEngine &engine)
+{
+  BenchResult r;
+  resetPeakRss();
+  long start_rss_kb = statusKb("VmRSS");
+  auto t = std::chrono::steady_clock::now();
+  Mat im = imdecode(encoded, IMREAD_COLOR);
+  r.load_ms = elapsedMs(t);
+
+  t = std::chrono::steady_clock::now();
+  RegionGrow rg;
+  initRegionGrow(&rg, im, thresh, 0, engine.threads, engine.engine);
+  rg.frontier.setOrder(engine.order);
+  labelRegionGrow(&rg);
+  r.label_ms = elapsedMs(t);
+
+  t = std::chrono::steady_clock::now();
+  colorRegionGrow(&rg);
+  r.colorize_ms = elapsedMs(t);
+
+  t = std::chrono::steady_clock::now();
+  std::vector<uchar> out;
+  imencode(".jpg", rg.SEGS, out);
+  r.encode_ms = elapsedMs(t);
+
+  r.regions = rg.currentRegion;
+  r.iterations = rg.iterations;
+  r.peak_rss_kb = peakRssKb(); // before the buffers are freed, in case the peak cannot be reset
+  r.run_rss_kb = start_rss_kb >= 0 ? std::max(0L, r.peak_rss_kb - start_rss_kb) : -1;
+  freeRegionGrow(&rg);
+  return r;
+}
+
+/**
+ * @brief Whether two label maps hold the same regions, up to their numbering
+ *
+ * The pixels of rejected regions, labeled `maxLabel()`, must be rejected in both.
+ */
+bool samePartition(const LabelMap &a, const LabelMap &b)
+{
+  if (a.mat().rows != b.mat().rows || a.mat().cols != b.mat().cols)
+    return false;
+  int n = a.mat().rows * a.mat().cols;
+  std::vector<uint32_t> ab(a.maxLabel() + 1, 0), ba(b.maxLabel() + 1, 0);
+  for (int idx = 0; idx < n; idx++)
+  {
+    uint32_t la = a.get(idx), lb = b.get(idx);
+    bool rejected = la == a.maxLabel();
+    if (rejected != (lb == b.maxLabel()) || (!rejected && (la == 0 || lb == 0)))
+      return false;
+    if (rejected)
+      continue;
+    if (ab[la] == 0 && ba[lb] == 0)
+    {
+      ab[la] = lb;
+      ba[lb] = la;
+    }
+    else if (ab[la] != lb || ba[lb] != la)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Whether every label of a map, but the rejected one, is a single connected region
+ */
+bool connectedLabels(const LabelMap &labels, int connectivity)
+{
+  const int h = labels.mat().rows, w = labels.mat().cols;
+  Neighbourhood nbh(h, w, connectivity);
+  std::vector<char> seen(labels.maxLabel() + 1, 0), visited((size_t)h * w, 0);
+  std::vector<int> stack;
+  for (int idx = 0; idx < h * w; idx++)
+  {
+    uint32_t label = labels.get(idx);
+    if (visited[idx] || label == labels.maxLabel())
+      continue;
+    if (seen[label])
+      return false; // a second part of the label
+    seen[label] = 1;
+    visited[idx] = 1;
+    stack.push_back(idx);
+    while (!stack.empty())
+    {
+      int p = stack.back();
+      stack.pop_back();
+      nbh.forEach(p / w, p % w, [&](int, int, int nidx)
+      {
+        if (!visited[nidx] && labels.get(nidx) == label)
+        {
+          visited[nidx] = 1;
+          stack.push_back(nidx);
+        }
+        return true;
+      });
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Change a random rectangle of a frame
+ *
+ * The rectangle gets a random color, or every third frame the color of a
+ * pixel next to it, so that regions merge, and every fifth frame only one of
+ * its pixels in two is painted, so that regions split.
+ */
+void paintRectangle(Mat &frame, RNG &rng, int f)
+{
+  int x0 = rng.uniform(0, frame.rows - 1), y0 = rng.uniform(0, frame.cols - 1);
+  int x1 = std::min(frame.rows, x0 + rng.uniform(1, 12)), y1 = std::min(frame.cols, y0 + rng.uniform(1, 12));
+  Vec3b color((uchar)rng.uniform(0, 256), (uchar)rng.uniform(0, 256), (uchar)rng.uniform(0, 256));
+  if (f % 3 == 0)
+    color = frame.at<Vec3b>(x0, std::min(frame.cols - 1, y1));
+  for (int x = x0; x < x1; x++)
+  {
+    for (int y = y0; y < y1; y++)
+    {
+      if (f % 5 != 4 || (x + y) % 2)
+        frame.at<Vec3b>(x, y) = color;
+    }
+  }
+}
+
+/**
+ * @brief Check incremental mode at tolerance 0 on a random frame sequence
+ *
+ * @param engine The engine of the full segmentations
+ * @param connectivity 4 or 8
+ * @param min_region Minimum region size, so that rejected pixels are claimed again
+ *
+ * @return The number of frames whose regions differ, up to their numbering,
+ * from those of a fresh Segmenter, or whose labels are not connected regions
+ */
+int checkIncremental(const BenchEngine &engine, int connectivity, int min_region)
+{
+  const int frames = 100;
+  SegmentParams params;
+  params.threshold = 12;
+  params.minRegion = min_region;
+  params.engine = engine.engine;
+  params.threads = engine.threads;
+  params.connectivity = connectivity;
+  SegmentParams incremental = params;
+  incremental.incremental = 0;
+  incremental.maxChanged = 0.5;
+  Segmenter segmenter(incremental);
+
+  Mat frame = synthImage(120, 160, 8);
+  RNG rng(7);
+  int failed = 0;
+  size_t regrown = 0;
+  for (int f = 0; f < frames; f++)
+  {
+    paintRectangle(frame, rng, f);
+    const LabelMap &labels = segmenter.segment(frame);
+    regrown += segmenter.regrown();
+    Segmenter full(params);
+    const LabelMap &expected = full.segment(frame);
+    if (segmenter.regions() != full.regions() || !samePartition(labels, expected) ||
+        (engine.engine != ENGINE_PYRAMID && !connectedLabels(labels, connectivity)))
+      failed++;
+  }
+  printf("incremental %s threads=%d connectivity=%d min_region=%d: %d of %d frames differ, %zu pixels regrown "
+         "per frame\n",
+         engine.name, engine.threads, connectivity, min_region, failed, frames, regrown / frames);
+  return failed;
+}
+
+/**
+ * @brief Whether two label maps hold the same labels
+ *
+ * The pixels of rejected regions, labeled `maxLabel()`, must be rejected in both.
+ */
+bool sameLabels(const LabelMap &a, const LabelMap &b)
+{
+  if (a.mat().rows != b.mat().rows || a.mat().cols != b.mat().cols)
+    return false;
+  int n = a.mat().rows * a.mat().cols;
+  for (int idx = 0; idx < n; idx++)
+  {
+    uint32_t la = a.get(idx), lb = b.get(idx);
+    bool rejected = la == a.maxLabel();
+    if (rejected != (lb == b.maxLabel()) || (!rejected && la != lb))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief An 8-bit image of 1, 3 or 4 channels derived from a CV_8UC3 one
+ *
+ * The gray level for 1 channel, and the three channels plus one mixing them for 4.
+ */
+Mat withChannels(const Mat &im, int channels)
+{
+  if (channels == 3)
+    return im;
+  Mat out(im.rows, im.cols, CV_MAKETYPE(CV_8U, channels));
+  for (int x = 0; x < im.rows; x++)
+  {
+    const Vec3b *row = im.ptr<Vec3b>(x);
+    uchar *dst = out.ptr<uchar>(x);
+    for (int y = 0; y < im.cols; y++)
+    {
+      const Vec3b &c = row[y];
+      if (channels == 1)
+        dst[y] = (uchar)((c[0] + c[1] + c[2]) / 3);
+      else
+      {
+        for (int k = 0; k < 3; k++)
+          dst[4 * y + k] = c[k];
+        dst[4 * y + 3] = (uchar)((c[0] + 2 * c[2]) / 3);
+      }
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Label an image with the serial flood fill of `labelRegionGrow()`, the reference of the checks
+ *
+ * @return The number of regions
+ */
+int referenceLabels(const Mat &im, double thresh, ColorMetric metric, int connectivity, int min_region,
+                    LabelMap &labels)
+{
+  RegionGrow rg;
+  initRegionGrow(&rg, im, thresh, min_region, 1, ENGINE_FLOOD);
+  rg.metric = metric;
+  rg.connectivity = connectivity;
+  labelRegionGrow(&rg);
+  rg.passedBy.copyTo(labels);
+  int regions = rg.currentRegion;
+  freeRegionGrow(&rg);
+  return regions;
+}
+
+/**
+ * @brief A configuration of the equivalence checks: image, metric, connectivity and minimum region size
+ */
+struct CheckCase
+{
+  int channels;
+  ColorMetric metric;
+  int connectivity;
+  int minRegion;
+};
+
+/**
+ * @brief Every CheckCase: 1, 3 and 4 channels, the three metrics, 4- and 8-connectivity, with and without rejection
+ */
+std::vector<CheckCase> checkCases()
+{
+  std::vector<CheckCase> cases;
+  for (int channels : {1, 3, 4})
+  {
+    for (ColorMetric metric : {METRIC_L2, METRIC_L1, METRIC_CHEBYSHEV})
+    {
+      for (int connectivity : {4, 8})
+      {
+        for (int min_region : {0, 5})
+          cases.push_back({channels, metric, connectivity, min_region});
+      }
+    }
+  }
+  return cases;
+}
+
+/**
+ * @brief Print the result of an equivalence check, and its first failing configuration
+ */
+void reportCheck(const char *name, int failed, int runs, const CheckCase &first, double thresh)
+{
+  static const char *const metrics[] = {"l2", "l1", "linf"};
+  printf("%s: %d of %d labelings differ from the serial flood fill", name, failed, runs);
+  if (failed)
+    printf(", first with %d channels, %s, connectivity %d, min_region %d, threshold %g", first.channels,
+           metrics[first.metric], first.connectivity, first.minRegion, thresh);
+  printf("\n");
+}
+
+/**
+ * @brief Check that a threshold sweep labels every threshold like the serial flood fill
+ *
+ * @param descending Whether to sweep the thresholds in descending order,
+ * which restarts the merges of the MergeTree at every threshold
+ *
+ * @return The number of labelings that differ
+ */
+int checkSweep(bool descending)
+{
+  std::vector<double> thresholds = {2, 4, 8, 12, 20, 32};
+  if (descending)
+    std::reverse(thresholds.begin(), thresholds.end());
+  Mat base = synthImage(120, 160, 8);
+  int failed = 0, runs = 0;
+  CheckCase first = {};
+  double firstThresh = 0;
+  for (const CheckCase &c : checkCases())
+  {
+    Mat im = withChannels(base, c.channels);
+    SegmentParams params;
+    params.minRegion = c.minRegion;
+    params.metric = c.metric;
+    params.connectivity = c.connectivity;
+    params.sweep = true;
+    Segmenter segmenter(params);
+    for (double thresh : thresholds)
+    {
+      params.threshold = (float)thresh;
+      segmenter.setParams(params);
+      const LabelMap &labels = segmenter.segment(im);
+      LabelMap expected;
+      int regions = referenceLabels(im, thresh, c.metric, c.connectivity, c.minRegion, expected);
+      runs++;
+      if (segmenter.regions() != regions || !sameLabels(labels, expected))
+      {
+        if (failed++ == 0)
+        {
+          first = c;
+          firstThresh = thresh;
+        }
+      }
+    }
+  }
+  reportCheck(descending ? "sweep descending" : "sweep ascending", failed, runs, first, firstThresh);
+  return failed;
+}
+
+/**
+ * @brief Check that an engine gives the labels of the serial flood fill
+ *
+ * @return The number of labelings that differ
+ */
+int checkEngine(const BenchEngine &engine)
+{
+  Mat base = synthImage(120, 160, 8);
+  int failed = 0, runs = 0;
+  CheckCase first = {};
+  double firstThresh = 0;
+  for (const CheckCase &c : checkCases())
+  {
+    Mat im = withChannels(base, c.channels);
+    SegmentParams params;
+    params.minRegion = c.minRegion;
+    params.metric = c.metric;
+    params.connectivity = c.connectivity;
+    params.engine = engine.engine;
+    params.threads = engine.threads;
+    params.order = engine.order;
+    Segmenter segmenter(params);
+    for (double thresh : {4.0, 12.0, 32.0})
+    {
+      params.threshold = (float)thresh;
+      segmenter.setParams(params);
+      const LabelMap &labels = segmenter.segment(im);
+      LabelMap expected;
+      int regions = referenceLabels(im, thresh, c.metric, c.connectivity, c.minRegion, expected);
+      runs++;
+      if (segmenter.regions() != regions || !sameLabels(labels, expected))
+      {
+        if (failed++ == 0)
+        {
+          first = c;
+          firstThresh = thresh;
+        }
+      }
+    }
+  }
+  std::string name = std::string("engine ") + engine.name + " threads=" + std::to_string(engine.threads);
+  reportCheck(name.c_str(), failed, runs, first, firstThresh);
+  return failed;
+}
+
+/**
+ * @brief Check that merging small regions keeps every region connected
+ *
+ * @param connectivity 4 or 8
+ *
+ * @return The number of thresholds at which a merged label is not one
+ * connected region
+ *
+ * The image is a checkerboard of 3 x 3 squares of two colors, which vary a
+ * little from square to square: at 4-connectivity every square is a region
+ * of its own, closest in color to the squares it touches only at a corner,
+ * which it must not merge with.
+ */
+int checkMerge(int connectivity)
+{
+  Mat im(120, 160, CV_8UC3);
+  for (int x = 0; x < im.rows; x++)
+  {
+    for (int y = 0; y < im.cols; y++)
+    {
+      int square = (x / 3) * 160 + y / 3, level = ((x / 3 + y / 3) % 2 ? 40 : 200) + square % 3;
+      im.at<Vec3b>(x, y) = Vec3b((uchar)level, (uchar)level, (uchar)level);
+    }
+  }
+  int failed = 0, runs = 0;
+  SegmentParams params;
+  params.connectivity = connectivity;
+  params.mergeBelow = 10;
+  Segmenter segmenter(params);
+  for (double thresh : {1.0, 2.0, 4.0})
+  {
+    params.threshold = (float)thresh;
+    segmenter.setParams(params);
+    runs++;
+    if (!connectedLabels(segmenter.segment(im), connectivity))
+      failed++;
+  }
+  printf("merge connectivity=%d: %d of %d labelings have a disconnected region\n", connectivity, failed, runs);
+  return failed;
+}
+
+/**
+ * @brief Run every check
+ *
+ * @param threads Threads of the parallel engines
+ *
+ * @return The number of failures
+ */
+int runChecks(int threads)
+{
+  int failed = checkSweep(false) + checkSweep(true);
+  std::vector<BenchEngine> engines = {{"flood", ENGINE_FLOOD, threads, ORDER_LIFO},
+                                      {"flood-fifo", ENGINE_FLOOD, 1, ORDER_FIFO},
+                                      {"scan", ENGINE_SCAN, 1, ORDER_LIFO},
+                                      {"scan", ENGINE_SCAN, threads, ORDER_LIFO},
+                                      {"opencl", ENGINE_OPENCL, 1, ORDER_LIFO}};
+  for (const BenchEngine &engine : engines)
+    failed += checkEngine(engine);
+  failed += checkMerge(4) + checkMerge(8);
+  const BenchEngine incrementalEngines[] = {{"flood", ENGINE_FLOOD, 1, ORDER_LIFO},
+                                            {"scan", ENGINE_SCAN, 1, ORDER_LIFO},
+                                            {"pyramid", ENGINE_PYRAMID, 1, ORDER_LIFO}};
+  for (const BenchEngine &engine : incrementalEngines)
+  {
+    for (int connectivity : {4, 8})
+    {
+      for (int min_region : {0, 5, 70})
+        failed += checkIncremental(engine, connectivity, min_region);
+    }
+  }
+  printf("%s: %d failures\n", failed ? "FAILED" : "passed", failed);
+  return failed;
+}
+
+/**
+ * @brief Print the command line usage
+ *
+ * @param prog Name of the program
+ */
+void usage(const char *prog)
+{
+  printf("Usage: %s [-s sizes] [-c cells] [-t thresholds] [-j threads] [-f csv|json] [-k]\n", prog);
+  printf("  -s  image sizes in megapixels (default 1,4,12,24,50)\n");
+  printf("  -c  side of the synthetic color cells in pixels (default 256,32,8)\n");
+  printf("  -t  thresholds (default 4,12,32)\n");
+  printf("  -j  threads of the parallel engines (default: number of CPUs)\n");
+  printf("  -f  output format (default csv)\n");
+  printf("  -k  check the labels of the engines and modes against each other instead, exiting with 1 on a failure\n");
+}
+
+/**
+ * @brief Benchmark the labeling engines on synthetic images
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ *
+ * @return 0 upon successful completion
+ *
+ * For every image size and cell size, this function generates a 4:3
+ * synthetic image and PNG encodes it once. It then segments it with every
+ * engine (serial and parallel flood fill and scanline union-find, the serial
+ * flood fill in FIFO order, the pyramid engine, and the OpenCL engine when a
+ * device is available) at every threshold, and prints one CSV line
+ * or JSON object per run with the time of each phase, the labeling
+ * throughput, the peak RSS during the run and the part of it the run
+ * itself allocated, and the number of regions. With `-k`, it runs the
+ * checks of `runChecks()` instead.
+ */
+int main(int argc, char **argv)
+{
+  std::vector<double> sizes = parseList("1,4,12,24,50");
+  std::vector<double> cells = parseList("256,32,8");
+  std::vector<double> thresholds = parseList("4,12,32");
+  int threads = getNumberOfCPUs();
+  bool json = false, check = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:t:j:f:k")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      sizes = parseList(optarg);
+      break;
+    case 'c':
+      cells = parseList(optarg);
+      break;
+    case 't':
+      thresholds = parseList(optarg);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'f':
+      json = strcmp(optarg, "json") == 0;
+      break;
+    case 'k':
+      check = true;
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (check)
+    return runChecks(std::max(threads, 2)) > 0 ? 1 : 0;
+
+  std::vector<BenchEngine> engines = {{"flood", ENGINE_FLOOD, 1, ORDER_LIFO},
+                                      {"flood-fifo", ENGINE_FLOOD, 1, ORDER_FIFO},
+                                      {"scan", ENGINE_SCAN, 1, ORDER_LIFO},
+                                      {"pyramid", ENGINE_PYRAMID, 1, ORDER_LIFO}};
+  if (threads > 1)
+  {
+    engines.push_back({"flood", ENGINE_FLOOD, threads, ORDER_LIFO});
+    engines.push_back({"scan", ENGINE_SCAN, threads, ORDER_LIFO});
+  }
+  if (ocl::useOpenCL())
+    engines.push_back({"opencl", ENGINE_OPENCL, 1, ORDER_LIFO});
+
+  if (json)
+    printf("[\n");
+  else
+    printf("megapixels,width,height,cell,engine,threads,threshold,load_ms,label_ms,colorize_ms,encode_ms,"
+           "mpixels_per_s,peak_rss_kb,run_rss_kb,regions,iterations\n");
+  bool first = true;
+  for (double mp : sizes)
+  {
+    int w = (int)(sqrt(mp * 1e6 * 4 / 3) + 0.5);
+    int h = (int)(mp * 1e6 / w + 0.5);
+    for (double cell : cells)
+    {
+      std::vector<uchar> encoded;
+      imencode(".png", synthImage(h, w, std::max(1, (int)cell)), encoded);
+      for (double thresh : thresholds)
+      {
+        for (const BenchEngine &engine : engines)
+        {
+          BenchResult r = runOnce(encoded, thresh, engine);
+          double mpps = (double)w * h / 1e6 / (r.label_ms / 1e3);
+          if (json)
+            printf("%s  {\"megapixels\": %g, \"width\": %d, \"height\": %d, \"cell\": %g, \"engine\": \"%s\", "
+                   "\"threads\": %d, \"threshold\": %g, \"load_ms\": %.3f, \"label_ms\": %.3f, "
+                   "\"colorize_ms\": %.3f, \"encode_ms\": %.3f, \"mpixels_per_s\": %.3f, "
+                   "\"peak_rss_kb\": %ld, \"run_rss_kb\": %ld, \"regions\": %d, \"iterations\": %d}",
+                   first ? "" : ",\n", mp, w, h, cell, engine.name, engine.threads, thresh, r.load_ms,
+                   r.label_ms, r.colorize_ms, r.encode_ms, mpps, r.peak_rss_kb, r.run_rss_kb, r.regions,
+                   r.iterations);
+          else
+            printf("%g,%d,%d,%g,%s,%d,%g,%.3f,%.3f,%.3f,%.3f,%.3f,%ld,%ld,%d,%d\n", mp, w, h, cell, engine.name,
+                   engine.threads, thresh, r.load_ms, r.label_ms, r.colorize_ms, r.encode_ms, mpps,
+                   r.peak_rss_kb, r.run_rss_kb, r.regions, r.iterations);
+          fflush(stdout);
+          first = false;
+        }
+      }
+    }
+  }
+  if (json)
+    printf("\n]\n");
+
+  return 0;
+}
@@ -1,62 +1,55 @@
 #include <opencv2/opencv.hpp>
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <vector>
 #include <iostream>
 #include <cmath>
-
-class Stack
+#include "color_distance.hpp"
+#include "bucket_queue.hpp"
+#include "frontier.hpp"
+#include "label_map.hpp"
+#include "neighbourhood.hpp"
+#include "region_journal.hpp"
+#include "region_stats.hpp"
+#include "run_stats.hpp"
+#include "seeds.hpp"
+#include "work_budget.hpp"
+
+// homogeneity criterion deciding whether a neighbour joins a region
+enum Criterion
 {
-public:
-  std::vector<std::pair<int, int>> item;
-
-  /**
-   * @brief Pushes a pair of integers to the stack
-   *
-   * @param value The pair of integers to push
-   */
-  void push(std::pair<int, int> value)
-  {
-    item.push_back(value);
-  }
-
-  /**
-   * @brief Pops a pair of integers from the stack
-   *
-   * @return The popped pair of integers
-   *
-   * Pops a pair of integers from the stack and returns it.
-   */
-  std::pair<int, int> pop()
-  {
-    std::pair<int, int> val = item.back();
-    item.pop_back();
-    return val;
-  }
-
-  size_t size()
-  {
-    return item.size();
-  }
-
-  bool isEmpty()
-  {
-    return item.empty();
-  }
-
-  void clear()
-  {
-    item.clear();
-  }
+  CRITERION_ADAPTIVE, // distance to the pixel it is reached from < max(thresh, channel 0 of the region mean)
+  CRITERION_ADAPTIVE_CHANNEL, // every channel difference to that pixel < max(thresh, that channel of the mean)
+  CRITERION_MEAN,     // distance to the region mean color < thresh
+  CRITERION_SIGMA     // distance to the region mean color < max(thresh, k * region standard deviation)
 };
 
 class RegionGrow
 {
 public:
-  cv::Mat im, passedBy, SEGS;
+  cv::Mat im, SEGS;
+  LabelMap passedBy;
   int h, w;
   int currentRegion = 0;
   int iterations = 0;
-  Stack stack;
+  GrowBudget budget; // deadline and pixel budget of the growth, none by default
+  WorkBudget work;   // budget being spent by ApplyRegionGrow
+  bool truncated = false; // the budget ran out before the growth was done
+  Frontier frontier;
+  RegionStats stats;
+  RunStats run; // counters and phase times
+  RegionJournal journal;
+  Neighbourhood nbh;
   double thresh;
+  Criterion criterion = CRITERION_ADAPTIVE;
+  double sigmaK = 2.0;   // k of CRITERION_SIGMA
+  bool priority = false; // grow all the seeds at once, most similar pixel first
+  int threads = 1;       // > 1 to grow the seeds concurrently
+
+  // number of integer color distances between two 8-bit colors, floor(sqrt(3) * 255) + 1
+  static const int PRIORITY_LEVELS = 442;
 
   /**
    * @brief Constructs a RegionGrow object
@@ -64,105 +57,172 @@ public:
    * @param img_path Path to the image to process
    * @param th Threshold value for region growing
    *
-   * Constructs a RegionGrow object with the given image path and threshold.
-   * It reads the image, sets the height and width of the image, allocates memory
-   * for the passedBy array, initializes the currentRegion and iterations to 0,
-   * initializes the SEGS Mat to zeros, and sets the threshold.
+   * Reads the image and constructs the object from it, see the constructor
+   * from an image.
    */
   RegionGrow(const std::string &img_path, double th)
   {
     readImage(img_path);
+    init(th);
+  }
+
+  /**
+   * @brief Constructs a RegionGrow object from an image in memory
+   *
+   * @param img The CV_8UC3 image to process, kept by reference
+   * @param th Threshold value for region growing
+   *
+   * It sets the height and width of the image, initializes the currentRegion
+   * and iterations to 0, initializes the SEGS Mat to zeros, resets the region
+   * statistics, reserves the frontier for every pixel, sets the threshold, and
+   * precomputes the 8-connected neighbourhood of the image. The passedBy label
+   * map is allocated by `ApplyRegionGrow`, once the number of seeds is known.
+   */
+  RegionGrow(const cv::Mat &img, double th) : im(img)
+  {
+    init(th);
+  }
+
+  /**
+   * @brief Size the buffers from the image, see the constructors
+   */
+  void init(double th)
+  {
     h = im.rows;
     w = im.cols;
-    passedBy = cv::Mat::zeros(h, w, CV_64F);
     SEGS = cv::Mat::zeros(h, w, CV_8UC3);
+    stats.reset((size_t)h * w);
+    frontier.reserve((size_t)h * w);
+    nbh = Neighbourhood(h, w, 8);
     thresh = th;
   }
 
   /**
-   * @brief Read an image from a file path and convert it to CV_32S
+   * @brief Read an image from a file path
    *
    * @param img_path Path to the image
    *
    * This function reads an image from the given file path using `cv::imread`.
-   * It then converts the image to the data type `CV_32S` using `cv::Mat::convertTo`.
+   * The image is kept in its native CV_8UC3 layout; distances are computed
+   * on the 8-bit data directly.
    */
   void readImage(const std::string &img_path)
   {
     im = cv::imread(img_path, cv::IMREAD_COLOR);
-    im.convertTo(im, CV_32S); // Convert to int
   }
 
-  std::vector<std::pair<int, int>> getNeighbour(int x0, int y0)
+  /**
+   * @brief Apply region growing algorithm to image
+   *
+   * @param seeds The list of starting points for region growing
+   * @param cv_display Whether or not to display the segmented image
+   *
+   * This function grows the regions from the seeds with `growFromSeeds`, with
+   * `growByPriority` if `priority` is set, or with `growConcurrently` if
+   * `threads` is above 1. Then it colors the segmented image SEGS, and
+   * displays it if asked to. Both phases are timed in `run`.
+   *
+   * The growth spends `budget` from the start of the call, one pixel per pixel
+   * taken from a frontier or queue, checked every `WorkBudget::CHECK_EVERY`
+   * pixels. When it runs out, growth stops: the regions keep the pixels
+   * labeled so far, even below the minimum size, the pixels not reached stay
+   * unlabeled (white), and `truncated` is set.
+   */
+  void ApplyRegionGrow(std::vector<std::pair<int, int>> &seeds, bool cv_display = true)
   {
-    std::vector<std::pair<int, int>> neighbours;
-    for (int i = -1; i <= 1; ++i)
     {
-      for (int j = -1; j <= 1; ++j)
+      PhaseTimer timer(run, PHASE_LABEL);
+      work.start(budget);
+      if (priority)
+        growByPriority(seeds);
+      else if (threads > 1)
+        growConcurrently(seeds);
+      else
+        growFromSeeds(seeds);
+      truncated = work.exhausted();
+      REGGROW_STAT(run.capHit = run.capHit || truncated);
+    }
+
+    {
+      PhaseTimer timer(run, PHASE_COLORIZE);
+      for (int i = 0; i < h; ++i)
       {
-        if ((i != 0 || j != 0) && boundaries(x0 + i, y0 + j))
+        for (int j = 0; j < w; ++j)
         {
-          neighbours.push_back(std::make_pair(x0 + i, y0 + j));
+          color_pixel(i, j);
         }
       }
     }
-    return neighbours;
+    if (cv_display)
+      display();
   }
 
   /**
-   * @brief Apply region growing algorithm to image
+   * @brief Grow the regions one at a time from the seeds
    *
-   * @param seeds The list of starting points for region growing
-   * @param cv_display Whether or not to display the segmented image
+   * @param seeds The list of starting points, extended with their neighbours
    *
-   * This function applies the region growing algorithm to the image.
+   * Each seed (and each of its neighbours) starts at most one region, so
+   * the passedBy label map is sized from the number of seeds.
    *
    * The algorithm starts from the given seeds and iteratively expands
    * each seed until it reaches the boundaries of the image. At each
    * iteration, the algorithm checks if the current pixel has been
    * processed before. If not, it sets the current region number,
-   * pushes the pixel to the stack, marks it as processed, and performs
+   * pushes the pixel to the frontier, marks it as processed, and performs
    * a Breadth-First Search on its neighbors. If the number of pixels
    * in the current region is less than 8 * 8, the algorithm resets
-   * the current region and starts from the last seed.
-   *
-   * After all seeds have been processed, the function either displays
-   * the segmented image or returns.
+   * the current region and starts from the last seed. The pixels popped, the
+   * neighbours tested and the regions created and reset are counted in `run`.
    */
-  void ApplyRegionGrow(std::vector<std::pair<int, int>> &seeds, bool cv_display = true)
+  void growFromSeeds(std::vector<std::pair<int, int>> &seeds)
   {
     std::vector<std::pair<int, int>> temp;
+    temp.reserve(9 * seeds.size()); // each seed and its 8 neighbours
     for (auto &i : seeds)
     {
       temp.push_back(i);
-      auto neighbours = getNeighbour(i.first, i.second);
-      temp.insert(temp.end(), neighbours.begin(), neighbours.end());
+      nbh.forEach(i.first, i.second, [&](int x, int y, int)
+      {
+        temp.push_back(std::make_pair(x, y));
+        return true;
+      });
     }
     seeds = temp;
+    passedBy.create(h, w, seeds.size());
+    GrowCounters counters;
 
     for (auto &i : seeds)
     {
       int x0 = i.first;
       int y0 = i.second;
 
-      if (passedBy.at<double>(x0, y0) == 0 && cv::norm(im.at<cv::Vec3i>(x0, y0)) > 0)
+      if (passedBy.get(x0, y0) == 0 && im.at<cv::Vec3b>(x0, y0) != cv::Vec3b(0, 0, 0))
       {
         currentRegion++;
-        passedBy.at<double>(x0, y0) = currentRegion;
-        stack.push(std::make_pair(x0, y0));
+        REGGROW_STAT(run.created++);
+        journal.begin();
+        label(x0, y0, currentRegion);
+        frontier.push(x0 * w + y0);
+        counters.frontier(frontier.size());
 
-        while (!stack.isEmpty())
+        while (!frontier.empty())
         {
-          auto [x, y] = stack.pop();
-          BFS(x, y);
+          if (!work.spend())
+          {
+            frontier.clear(); // already labeled, left unvisited
+            break;
+          }
+          int idx = frontier.pop();
+          counters.pop();
+          BFS(idx / w, idx % w, counters);
           iterations++;
         }
 
         if (PassedAll())
           break;
 
-        int count = cv::countNonZero(passedBy == currentRegion);
-        if (count < 8 * 8)
+        if (stats.count(currentRegion) < 8 * 8)
         {
           auto [new_x, new_y] = reset_region(x0, y0);
           x0 = new_x;
@@ -170,34 +230,217 @@ public:
         }
       }
     }
+    run.grow.add(counters);
+  }
 
-    if (cv_display)
+  /**
+   * @brief Grow every region at once, most similar pixel first (seeded region growing)
+   *
+   * @param seeds The list of starting points, one region each
+   *
+   * Every seed starts a region. The unlabeled neighbours of the regions wait
+   * in a single bucket queue, ordered by the (integer) color distance to the
+   * running mean of the region they border. The closest pixel over all the
+   * regions is always expanded first: it joins its region if its distance is
+   * below the threshold, and its own unlabeled neighbours are queued. A pixel
+   * whose region mean moved away since it was queued is queued again with
+   * its new distance before being considered. The result does not depend on
+   * the order of the seeds beyond ties, and the cost is near-linear in the
+   * number of pixels grown. Every entry taken from the queue counts as popped
+   * in `run`, and the peak frontier is the largest queue. Regions are never
+   * rolled back, whatever their size: they grow together, so rolling a small
+   * one back would leave a hole that no region grows into again.
+   */
+  void growByPriority(const std::vector<std::pair<int, int>> &seeds)
+  {
+    passedBy.create(h, w, seeds.size());
+    BucketQueue queue(PRIORITY_LEVELS);
+    GrowCounters counters;
+    const double thresh2 = thresh * thresh;
+
+    auto enqueueNeighbours = [&](int x0, int y0, uint32_t region)
     {
-      for (int i = 0; i < h; ++i)
+      nbh.forEach(x0, y0, [&](int x, int y, int nidx)
       {
-        for (int j = 0; j < w; ++j)
+        if (passedBy.get(nidx) == 0)
+          queue.push(priorityLevel(meanDistance2(x, y, stats.mean(region))), nidx, region);
+        return true;
+      });
+    };
+
+    for (auto &i : seeds)
+    {
+      if (passedBy.get(i.first, i.second) == 0 && im.at<cv::Vec3b>(i.first, i.second) != cv::Vec3b(0, 0, 0))
+      {
+        assign(i.first, i.second, ++currentRegion);
+        REGGROW_STAT(run.created++);
+      }
+    }
+    for (auto &i : seeds)
+    {
+      uint32_t region = passedBy.get(i.first, i.second);
+      if (region != 0)
+        enqueueNeighbours(i.first, i.second, region);
+    }
+
+    while (!queue.empty() && work.spend())
+    {
+      counters.frontier(queue.size());
+      BucketQueue::Entry e = queue.pop();
+      counters.pop();
+      if (passedBy.get(e.idx) != 0)
+        continue; // claimed since it was queued
+      int x = e.idx / w, y = e.idx % w;
+      double d2 = meanDistance2(x, y, stats.mean(e.tag));
+      uint32_t level = priorityLevel(d2);
+      if (level > e.priority)
+      {
+        queue.push(level, e.idx, e.tag);
+        continue;
+      }
+      if (!counters.test(d2 < thresh2))
+        continue;
+      assign(x, y, e.tag);
+      iterations++;
+      enqueueNeighbours(x, y, e.tag);
+    }
+    run.grow.add(counters);
+  }
+
+  /**
+   * @brief Grow every seed at the same time on a pool of threads
+   *
+   * @param seeds The list of starting points, one region each
+   *
+   * Region i + 1 grows from seeds[i] with the criterion of `BFS`, and regions
+   * of fewer than 8 * 8 pixels are given back, as in `growFromSeeds`. The
+   * seeds are handed out one at a time to the `cv::parallel_for_` pool, so an
+   * idle thread takes the next seed while the others are still growing
+   * large regions. The regions share the label map: every pixel is claimed
+   * with a compare-and-swap, and the running moments of a region are local
+   * to the thread growing it.
+   *
+   * Conflicts follow the first-arrival rule: a pixel that two regions could
+   * both accept belongs to the region that claims it first. Regions that do
+   * not touch are the same as with `growFromSeeds`, but the boundary between
+   * two touching regions, and whether a seed lying inside an earlier region
+   * starts a region at all, depend on thread timing. Unlike `growFromSeeds`,
+   * the seeds are not extended with their neighbours. The threads share the
+   * budget, each taking its pixels in chunks of its own. Every seed keeps its
+   * own counters, added to `run` once every seed is grown; the peak frontier
+   * is the largest one of a single region.
+   */
+  void growConcurrently(const std::vector<std::pair<int, int>> &seeds)
+  {
+    const int n = (int)seeds.size();
+    passedBy.create(h, w, seeds.size());
+    std::vector<ColorMoments> moments(n + 1);
+    std::vector<GrowCounters> counters(n);
+    std::atomic<int> visited(0), created(0), rolledBack(0);
+
+    cv::setNumThreads(threads);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range)
+    {
+      Frontier local;
+      RegionJournal claimed;
+      uint32_t countdown = 0; // pixels left in the chunk of budget of this thread
+      for (int s = range.start; s < range.end && !work.exhausted(); s++)
+      {
+        const uint32_t region = s + 1;
+        const int seed = seeds[s].first * w + seeds[s].second;
+        if (im.at<cv::Vec3b>(seeds[s].first, seeds[s].second) == cv::Vec3b(0, 0, 0) || !passedBy.claim(seed, region))
+          continue;
+
+        ColorMoments &m = moments[region];
+        GrowCounters &c = counters[s];
+        REGGROW_STAT(created++);
+        claimed.begin();
+        claimed.record(seed);
+        m.add(im.at<cv::Vec3b>(seeds[s].first, seeds[s].second));
+        local.push(seed);
+        c.frontier(local.size());
+        int steps = 0;
+        bool cut = false; // the budget ran out while growing this region
+        while (!local.empty())
         {
-          color_pixel(i, j);
+          if (!work.spend(countdown))
+          {
+            local.clear(); // already claimed, left unvisited
+            cut = true;
+            break;
+          }
+          int idx = local.pop();
+          int x0 = idx / w, y0 = idx % w;
+          int var2 = squaredThreshold(thresh);
+          steps++;
+          c.pop();
+          nbh.forEach(x0, y0, [&](int x, int y, int nidx)
+          {
+            if (passedBy.available(nidx) && c.test(accepts(x, y, x0, y0, m, var2)) && passedBy.claim(nidx, region))
+            {
+              claimed.record(nidx);
+              m.add(im.at<cv::Vec3b>(x, y));
+              local.push(nidx);
+              c.frontier(local.size());
+              if (criterion == CRITERION_ADAPTIVE)
+                var2 = squaredThreshold(std::max(m.mean[0], thresh));
+            }
+            return true;
+          });
+        }
+        visited += steps;
+
+        if (m.count < 8 * 8 && !cut)
+        {
+          const int *pixels = claimed.pixels();
+          for (size_t i = 0; i < claimed.size(); i++)
+            passedBy.unclaim(pixels[i]);
+          m = ColorMoments();
+          REGGROW_STAT(rolledBack++);
         }
       }
-      display();
+    }, (double)n);
+
+    iterations += visited;
+    for (const GrowCounters &c : counters)
+      run.grow.add(c);
+    run.created += created;
+    run.rolledBack += rolledBack;
+    for (int region = 1; region <= n; region++)
+    {
+      if (moments[region].count == 0)
+        continue;
+      stats.assign(region, moments[region]);
+      currentRegion++;
     }
   }
 
+  /**
+   * @brief Priority of a pixel at a squared color distance from a region mean
+   *
+   * @return The distance rounded down, in [0, PRIORITY_LEVELS)
+   */
+  static uint32_t priorityLevel(double d2)
+  {
+    return (uint32_t)std::sqrt(d2);
+  }
+
   /**
    * @brief Reset the region growing to the previous region.
    *
    * @param x0 The x-coordinate of the starting point.
    * @param y0 The y-coordinate of the starting point.
    *
-   * This function resets the region growing to the previous region. It sets the value of
-   * the passedBy array to 0 where the value is equal to the currentRegion. It then decrements
-   * the currentRegion by 1. It returns a pair of the previous x-coordinate and previous y-coordinate.
+   * This function resets the region growing to the previous region. It rolls back the
+   * pixels recorded in the journal for the currentRegion, setting their passedBy value to 0,
+   * and drops the region from the statistics. It then decrements the currentRegion by 1. It returns a pair of the previous x-coordinate and previous y-coordinate.
    */
   std::pair<int, int> reset_region(int x0, int y0)
   {
-    passedBy.setTo(0, passedBy == currentRegion);
+    passedBy.rollback(journal);
+    stats.dropRegion(currentRegion);
     currentRegion--;
+    REGGROW_STAT(run.rolledBack++);
     return std::make_pair(x0 - 1, y0 - 1);
   }
 
@@ -206,40 +449,130 @@ public:
    *
    * @param x0 The x-coordinate of the starting point.
    * @param y0 The y-coordinate of the starting point.
+   * @param counters Receives the neighbour tests and the frontier size.
    *
    * This function performs Breadth-First Search on the image starting from the given coordinates.
-   * It initializes the region number to the value of the passedBy array at the starting point,
-   * initializes the vector of elements with the mean of the pixel value at the starting point,
-   * initializes the variance to the threshold, and gets the neighbors of the starting point.
-   * It then iterates over the neighbors. If the neighbor has not been processed before and the
-   * distance between the current coordinate and its neighbor is less than the variance, it sets
-   * the passedBy value of the neighbor to the region number, pushes the neighbor to the stack,
-   * adds the mean of the pixel value at the neighbor to the vector of elements, and updates the
-   * variance to the mean of the vector of elements. If the number of pixels in the current region
-   * is less than 8 * 8, the function resets the region to the previous region.
+   * It initializes the region number to the value of the passedBy label map at the starting point,
+   * and initializes the variance to the threshold. It then visits the neighbors of the starting
+   * point through the precomputed neighbourhood. If the neighbor has not been processed before and
+   * passes the homogeneity criterion (see `accepts()`), it labels the neighbor with the region
+   * number and pushes the neighbor to the frontier. With `CRITERION_ADAPTIVE`, the neighbor must be
+   * closer to the current coordinate than the variance, which is then updated to the running mean
+   * of the region kept in `stats`; distances are compared squared, against the square of the
+   * variance. `CRITERION_ADAPTIVE_CHANNEL` bounds each channel of the step by the matching
+   * channel of the mean. The other criteria compare the neighbor to the running mean color of the
+   * region.
    */
-  void BFS(int x0, int y0)
+  void BFS(int x0, int y0, GrowCounters &counters)
   {
-    double regionNum = passedBy.at<double>(x0, y0);
-    std::vector<double> elems = {cv::mean(im.at<cv::Vec3i>(x0, y0))[0]};
+    uint32_t regionNum = passedBy.get(x0, y0);
 
-    double var = thresh;
-    auto neighbours = getNeighbour(x0, y0);
+    int var2 = squaredThreshold(thresh);
 
-    for (auto &[x, y] : neighbours)
+    nbh.forEach(x0, y0, [&](int x, int y, int)
     {
-      if (passedBy.at<double>(x, y) == 0 && distance(x, y, x0, y0) < var)
+      if (passedBy.get(x, y) == 0 && counters.test(accepts(x, y, x0, y0, stats.moments(regionNum), var2)))
       {
         if (PassedAll())
-          break;
+          return false;
 
-        passedBy.at<double>(x, y) = regionNum;
-        stack.push(std::make_pair(x, y));
-        elems.push_back(cv::mean(im.at<cv::Vec3i>(x, y))[0]);
-        var = cv::mean(elems)[0];
+        label(x, y, regionNum);
+        frontier.push(x * w + y);
+        counters.frontier(frontier.size());
+        if (criterion == CRITERION_ADAPTIVE)
+          var2 = squaredThreshold(std::max(stats.mean(regionNum)[0], thresh));
       }
-      var = std::max(var, thresh);
+      return true;
+    });
+  }
+
+  /**
+   * @brief Check the homogeneity criterion for a neighbour
+   *
+   * @param x The x-coordinate of the neighbour
+   * @param y The y-coordinate of the neighbour
+   * @param x0 The x-coordinate of the pixel it is reached from
+   * @param y0 The y-coordinate of the pixel it is reached from
+   * @param region The color moments of the region of (x0, y0)
+   * @param var2 Squared distance bound of `CRITERION_ADAPTIVE`
+   *
+   * @return Whether the neighbour joins the region. The region mean and
+   * standard deviation are O(1) reads of the running moments.
+   *
+   * The bound of `CRITERION_ADAPTIVE` is the first (blue) channel of the
+   * region mean, an intensity used as a color distance, so bright blue
+   * regions accept much larger steps than dark or red ones.
+   * `CRITERION_ADAPTIVE_CHANNEL` bounds every channel by its own mean instead.
+   */
+  bool accepts(int x, int y, int x0, int y0, const ColorMoments &region, int var2) const
+  {
+    if (criterion == CRITERION_ADAPTIVE)
+      return distance2(x, y, x0, y0) < var2;
+    if (criterion == CRITERION_ADAPTIVE_CHANNEL)
+      return channelsClose(x, y, x0, y0, region.mean);
+
+    double bound = criterion == CRITERION_SIGMA ? std::max(thresh, sigmaK * region.stddev()) : thresh;
+    return meanDistance2(x, y, region.mean) < bound * bound;
+  }
+
+  /**
+   * @brief Whether every channel of a pixel is close to the pixel it is reached from
+   *
+   * @return Whether the difference in each channel is below the larger of
+   * the threshold and the region mean of that channel
+   */
+  bool channelsClose(int x, int y, int x0, int y0, const cv::Vec3d &mean) const
+  {
+    const cv::Vec3b &a = im.at<cv::Vec3b>(x, y), &b = im.at<cv::Vec3b>(x0, y0);
+    for (int c = 0; c < 3; c++)
+    {
+      if (std::abs(a[c] - b[c]) >= std::max(thresh, mean[c]))
+        return false;
     }
+    return true;
+  }
+
+  /**
+   * @brief Squared distance between the color of a pixel and a mean color
+   */
+  double meanDistance2(int x, int y, const cv::Vec3d &mean) const
+  {
+    cv::Vec3d d = cv::Vec3d(im.at<cv::Vec3b>(x, y)) - mean;
+    return d.dot(d);
+  }
+
+  /**
+   * @brief Assign a pixel to a region
+   *
+   * @param x The x-coordinate of the pixel
+   * @param y The y-coordinate of the pixel
+   * @param region The region number to assign
+   *
+   * Writes the label and updates the running region statistics. Every label
+   * write must go through this function, or through `label()`, so that
+   * `stats` stays consistent. Use it directly only for growth that never
+   * rolls a region back, as `growByPriority` does.
+   */
+  void assign(int x, int y, int region)
+  {
+    passedBy.set(x, y, region);
+    stats.add(region, im.at<cv::Vec3b>(x, y));
+  }
+
+  /**
+   * @brief Assign a pixel to the region currently growing, which may be rolled back
+   *
+   * @param x The x-coordinate of the pixel
+   * @param y The y-coordinate of the pixel
+   * @param region The region number to assign
+   *
+   * Like `assign()`, and records the pixel in the journal, for
+   * `reset_region()` to undo the region.
+   */
+  void label(int x, int y, int region)
+  {
+    assign(x, y, region);
+    journal.record(x * w + y);
   }
 
   /**
@@ -249,14 +582,13 @@ public:
    * @param j The y-coordinate of the pixel
    *
    * This function sets the color of a pixel in the segmented image. If the pixel
-   * is not part of a region, it sets the color to white. Otherwise, it scales
-   * the region number to values between 35 and 90 for the red channel, and
-   * values between 30 and 270 for the green and blue channels.
+   * is not part of a region, it sets the color to white. Otherwise, it uses the
+   * color of the region number given by `labelColor()`, distinct for every region.
    */
   void color_pixel(int i, int j)
   {
-    double val = passedBy.at<double>(i, j);
-    SEGS.at<cv::Vec3b>(i, j) = (val == 0) ? cv::Vec3b(255, 255, 255) : cv::Vec3b(val * 35, val * 90, val * 30);
+    uint32_t val = passedBy.get(i, j);
+    SEGS.at<cv::Vec3b>(i, j) = (val == 0) ? cv::Vec3b(255, 255, 255) : labelColor(val);
   }
 
   /**
@@ -276,64 +608,52 @@ public:
   /**
    * @brief Check if the region growing algorithm has passed all pixels
    *
-   * @param max_iteration The maximum number of iterations to perform
-   *
-   * @return True if either the maximum number of iterations has been reached,
-   * or all pixels have been assigned to a region. False otherwise.
+   * @return True if either the budget ran out, or all pixels have been
+   * assigned to a region. False otherwise.
    *
    * This function checks if the region growing algorithm has passed all pixels
-   * by comparing the number of iterations to the maximum number of iterations
-   * and the number of pixels that have been assigned to a region to the total
-   * number of pixels in the image.
+   * by reading the state of `work`, which is only updated every few pixels, and
+   * the assigned-pixel counter kept in `stats`; it never scans the image.
    */
-  bool PassedAll(int max_iteration = 200000)
+  bool PassedAll() const
   {
-    return iterations > max_iteration || cv::countNonZero(passedBy > 0) == h * w;
+    return work.exhausted() || stats.complete();
   }
 
   /**
-   * @brief Check if the given coordinates are within the boundaries of the
-   * image.
-   *
-   * @param x The x-coordinate to check
-   * @param y The y-coordinate to check
+   * @brief Squared color distance between two pixels of the image
    *
-   * @return True if the coordinates are within the image boundaries, false
-   * otherwise.
+   * @param x The x-coordinate of the first pixel
+   * @param y The y-coordinate of the first pixel
+   * @param x0 The x-coordinate of the second pixel
+   * @param y0 The y-coordinate of the second pixel
    *
-   * This function checks if the given coordinates are within the boundaries of
-   * the image by comparing the coordinates to the height and width of the image.
+   * @return The squared Euclidean distance between the two pixel colors.
    */
-  bool boundaries(int x, int y)
-  {
-    return x >= 0 && x < h && y >= 0 && y < w;
-  }
-
-  double distance(int x, int y, int x0, int y0)
+  int distance2(int x, int y, int x0, int y0) const
   {
-    return cv::norm(im.at<cv::Vec3i>(x0, y0) - im.at<cv::Vec3i>(x, y));
+    return ::distance2(im.at<cv::Vec3b>(x0, y0), im.at<cv::Vec3b>(x, y));
   }
 };
 
-std::vector<std::pair<int, int>> seeds;
-
 /**
  * @brief Callback function for mouse events in the image window.
  *
  * @param event The type of mouse event that occurred
  * @param x The x-coordinate of the mouse event
  * @param y The y-coordinate of the mouse event
- * @param, void * unused
+ * @param, int unused
+ * @param userdata The std::vector<Seed> receiving the seeds
  *
  * This function adds the coordinates of a mouse click to the seeds vector if the
  * left mouse button is pressed. It closes all windows if the right mouse button is
  * pressed.
  */
-void get_seeds(int event, int x, int y, int, void *)
+void get_seeds(int event, int x, int y, int, void *userdata)
 {
   if (event == cv::EVENT_LBUTTONDOWN)
   {
-    seeds.push_back(std::make_pair(y, x));
+    static_cast<std::vector<Seed> *>(userdata)->push_back(std::make_pair(y, x));
   }
   else if (event == cv::EVENT_RBUTTONDOWN)
   {
@@ -341,43 +661,222 @@ void get_seeds(int event, int x, int y, int, void *)
   }
 }
 
+/**
+ * @brief Print the command line usage
+ *
+ * @param prog The name of the program
+ */
+void usage(const char *prog)
+{
+  std::cerr << "Usage: " << prog << " [-c adaptive|adaptive-channel|mean|sigma] [-k <k>] [-p] [-j <threads>]"
+            << " [-s <seeds.csv|seeds.json>] [-g <step>] [-a <step>] [-B <max_pixels>] [-D <ms>] [-o <output>]"
+            << " [-T <stats>] [-n] <image_path> <threshold>"
+            << std::endl;
+  std::cerr << "  -c  adaptive (default): step from the neighbour below max(threshold, blue channel of the region"
+            << " mean)\n"
+            << "      adaptive-channel: every channel of the step below max(threshold, that channel of the mean)\n"
+            << "      mean: distance to the region mean below the threshold\n"
+            << "      sigma: distance to the region mean below max(threshold, k * region standard deviation)"
+            << std::endl;
+}
+
 /**
  * @brief Main function for the program.
  *
  * @param argc The number of command line arguments.
  * @param argv An array of strings containing the command line arguments.
  *
- * This function reads an image from the given file path using `cv::imread`.
- * It then converts the image to the data type `CV_32S` using `cv::Mat::convertTo`.
- * It initializes a RegionGrow object with the given image path and threshold.
- * It creates a window named "image" and sets a callback function for mouse events.
- * It shows the image in the window. It waits for a key press.
- * It applies the region growing algorithm to the image with the given seeds.
- * It displays the segmented image.
+ * It parses the homogeneity criterion options (`-c`, and `-k` for the sigma criterion), the
+ * priority growth option (`-p`) and the number of threads growing the seeds concurrently (`-j`).
+ * The seeds are read from a CSV or JSON file (`-s`), placed on a grid (`-g`) or at the local
+ * minima of the color gradient (`-a`); these sources add up. Without any of them, the seeds are
+ * clicked in a window named "image", which is closed with a key press.
+ * It initializes a RegionGrow object with the given image and threshold, applies the region growing
+ * algorithm to the image with the seeds, writes the segmented image to the output if one is given
+ * (`-o`), and displays it unless `-n` is given. The growth visits at most `-B` pixels and stops after
+ * `-D` milliseconds (both unbounded by default), and a warning is printed when it stops early. With `-T`, a JSON line of the
+ * counters and phase times of the run is appended to a file, or printed with `-T -`. No window is opened when the seeds are not clicked
+ * and `-n` is given.
  *
  * @return 0 upon successful completion.
  *
- * @throws std::invalid_argument if the number of command line arguments is not 3.
+ * Returns -1 with the usage message if the options or the number of arguments are invalid, and -1
+ * if the image, the seeds file or the output cannot be read or written.
  */
 int main(int argc, char **argv)
 {
-  if (argc != 3)
+  Criterion criterion = CRITERION_ADAPTIVE;
+  double sigma_k = 2.0;
+  bool priority = false;
+  int threads = 1;
+  std::string seeds_path, output;
+  int grid_step = 0, minima_step = 0;
+  bool display = true;
+  GrowBudget budget;
+  std::string run_stats;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:k:pj:s:g:a:B:D:o:T:n")) != -1)
   {
-    std::cerr << "Usage: " << argv[0] << " <image_path> <threshold>" << std::endl;
+    switch (opt)
+    {
+    case 'c':
+      if (strcmp(optarg, "adaptive") == 0)
+        criterion = CRITERION_ADAPTIVE;
+      else if (strcmp(optarg, "adaptive-channel") == 0)
+        criterion = CRITERION_ADAPTIVE_CHANNEL;
+      else if (strcmp(optarg, "mean") == 0)
+        criterion = CRITERION_MEAN;
+      else if (strcmp(optarg, "sigma") == 0)
+        criterion = CRITERION_SIGMA;
+      else
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'k':
+      sigma_k = atof(optarg);
+      break;
+    case 'p':
+      priority = true;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      if (threads < 1)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 's':
+      seeds_path = optarg;
+      break;
+    case 'g':
+      grid_step = atoi(optarg);
+      if (grid_step < 1)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'a':
+      minima_step = atoi(optarg);
+      if (minima_step < 1)
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'B':
+      if (!budget.parseMaxPixels(optarg))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'D':
+      if (!budget.parseDeadline(optarg))
+      {
+        usage(argv[0]);
+        return -1;
+      }
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'T':
+      run_stats = optarg;
+      break;
+    case 'n':
+      display = false;
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  bool clicked = seeds_path.empty() && grid_step == 0 && minima_step == 0;
+  if (argc - optind != 2 || (clicked && !display))
+  {
+    usage(argv[0]);
     return -1;
   }
 
-  std::string img_path = argv[1];
-  double thresh = std::stod(argv[2]);
+  std::string img_path = argv[optind];
+  double thresh = std::stod(argv[optind + 1]);
 
-  RegionGrow exemple(img_path, thresh);
+  RunStats io; // phases outside of ApplyRegionGrow
+  cv::Mat im;
+  {
+    PhaseTimer timer(io, PHASE_LOAD);
+    im = cv::imread(img_path, cv::IMREAD_COLOR);
+  }
+  RegionGrow exemple(im, thresh);
+  if (exemple.im.empty())
+  {
+    std::cerr << "Cannot read " << img_path << std::endl;
+    return -1;
+  }
+  exemple.criterion = criterion;
+  exemple.sigmaK = sigma_k;
+  exemple.priority = priority;
+  exemple.threads = threads;
+  exemple.budget = budget;
+
+  std::vector<Seed> seeds;
+  if (!seeds_path.empty() && !readSeeds(seeds_path, seeds))
+  {
+    std::cerr << "Cannot read the seeds of " << seeds_path << std::endl;
+    return -1;
+  }
+  if (grid_step > 0)
+  {
+    std::vector<Seed> grid = gridSeeds(exemple.h, exemple.w, grid_step);
+    seeds.insert(seeds.end(), grid.begin(), grid.end());
+  }
+  if (minima_step > 0)
+  {
+    std::vector<Seed> minima = minimaSeeds(exemple.im, minima_step);
+    seeds.insert(seeds.end(), minima.begin(), minima.end());
+  }
+  if (size_t outside = clipSeeds(seeds, exemple.h, exemple.w))
+    std::cerr << "Ignoring " << outside << " seeds outside the image" << std::endl;
+
+  if (clicked)
+  {
+    cv::namedWindow("image");
+    cv::setMouseCallback("image", get_seeds, &seeds);
+    cv::imshow("image", exemple.im);
+    cv::waitKey(0);
+  }
 
-  cv::namedWindow("image");
-  cv::setMouseCallback("image", get_seeds);
-  cv::imshow("image", cv::imread(img_path, cv::IMREAD_COLOR));
-  cv::waitKey(0);
+  exemple.ApplyRegionGrow(seeds, display);
+  if (exemple.truncated)
+    std::cerr << "Ran out of budget, unreached pixels are left unlabeled (see -B and -D)" << std::endl;
 
-  exemple.ApplyRegionGrow(seeds);
+  bool saved = true;
+  if (!output.empty())
+  {
+    PhaseTimer timer(io, PHASE_SAVE);
+    saved = cv::imwrite(output, exemple.SEGS);
+  }
+  if (!saved)
+  {
+    std::cerr << "Cannot write " << output << std::endl;
+    return -1;
+  }
 
+  if (!run_stats.empty())
+  {
+    FILE *f = run_stats == "-" ? stdout : fopen(run_stats.c_str(), "a");
+    exemple.run.add(io);
+    if (!f || !exemple.run.write(f, img_path.c_str(), exemple.w, exemple.h, exemple.currentRegion))
+    {
+      std::cerr << "Cannot write " << run_stats << std::endl;
+      return -1;
+    }
+    if (f != stdout)
+      fclose(f);
+  }
   return 0;
 }
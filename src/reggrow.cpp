@@ -0,0 +1,438 @@
+#include "reggrow.hpp"
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+/**
+ * @brief Append the pixels of an image farther than a tolerance from their reference color
+ *
+ * @param im The image
+ * @param ref The reference colors, an image of the size and type of im
+ * @param tolerance Distance of metric M a pixel has to exceed to have changed
+ * @param changed Receives the linear indices (x * w + y) of the changed pixels
+ */
+template <typename T, int CN, ColorMetric M>
+static void diffPixels(const cv::Mat &im, const cv::Mat &ref, double tolerance, std::vector<uint32_t> &changed)
+{
+  typedef typename DistanceType<T>::type D;
+  double t = M == METRIC_L2 ? tolerance * tolerance : tolerance;
+  if (!std::is_floating_point<D>::value)
+    t = std::min(std::floor(t), (double)std::numeric_limits<D>::max());
+  const D limit = (D)t;
+  for (int x = 0; x < im.rows; x++)
+  {
+    const T *row = im.ptr<T>(x), *refRow = ref.ptr<T>(x);
+    for (int y = 0; y < im.cols; y++)
+    {
+      if (pixelDistance<M, CN>(row + CN * y, refRow + CN * y) > limit)
+        changed.push_back((uint32_t)(x * im.cols + y));
+    }
+  }
+}
+
+typedef void (*DiffKernel)(const cv::Mat &, const cv::Mat &, double, std::vector<uint32_t> &);
+
+template <typename T, int CN>
+static DiffKernel pickDiff(ColorMetric metric)
+{
+  switch (metric)
+  {
+  case METRIC_L1:
+    return diffPixels<T, CN, METRIC_L1>;
+  case METRIC_CHEBYSHEV:
+    return diffPixels<T, CN, METRIC_CHEBYSHEV>;
+  default:
+    return diffPixels<T, CN, METRIC_L2>;
+  }
+}
+
+template <typename T>
+static DiffKernel pickDiff(int channels, ColorMetric metric)
+{
+  switch (channels)
+  {
+  case 1:
+    return pickDiff<T, 1>(metric);
+  case 3:
+    return pickDiff<T, 3>(metric);
+  case 4:
+    return pickDiff<T, 4>(metric);
+  default:
+    return NULL;
+  }
+}
+
+/**
+ * @brief Kernel comparing images of a type to their reference colors, or NULL if there is none
+ */
+static DiffKernel pickDiff(int type, ColorMetric metric)
+{
+  switch (CV_MAT_DEPTH(type))
+  {
+  case CV_8U:
+    return pickDiff<uchar>(CV_MAT_CN(type), metric);
+  case CV_16U:
+    return pickDiff<ushort>(CV_MAT_CN(type), metric);
+  case CV_32F:
+    return pickDiff<float>(CV_MAT_CN(type), metric);
+  default:
+    return NULL;
+  }
+}
+
+Segmenter::Segmenter(const SegmentParams &params) : p(params)
+{
+}
+
+Segmenter::~Segmenter()
+{
+  if (started)
+    freeRegionGrow(&rg);
+}
+
+/**
+ * @brief Lend a label map to a RegionGrow object for the lifetime of the lender
+ *
+ * Swaps the maps back on destruction, also when labeling throws.
+ */
+struct LabelLender
+{
+  LabelMap &own, &borrowed;
+
+  LabelLender(LabelMap &own, LabelMap &borrowed) : own(own), borrowed(borrowed)
+  {
+    std::swap(own, borrowed);
+  }
+
+  ~LabelLender()
+  {
+    std::swap(own, borrowed);
+  }
+};
+
+cv::Mat Segmenter::convert(const cv::Mat &im, RunStats &conversion)
+{
+  PhaseTimer timer(conversion, PHASE_CONVERT);
+  return colors.convert(im, p.colorSpace);
+}
+
+void Segmenter::prepare(const cv::Mat &input, const RunStats &conversion)
+{
+  if (started)
+    reuseRegionGrow(&rg, input);
+  else
+  {
+    initRegionGrow(&rg, input, p.threshold, p.minRegion, p.threads, p.engine);
+    started = true;
+  }
+  rg.stats.add(conversion);
+  rg.thresh = p.threshold;
+  rg.minRegion = p.minRegion;
+  rg.threads = p.threads;
+  rg.engine = p.engine;
+  rg.frontier.setOrder(p.order);
+  rg.levels = p.pyramidLevels;
+  rg.budget = p.budget;
+  rg.metric = p.metric;
+  rg.connectivity = p.connectivity;
+  regrownPixels = (size_t)rg.h * rg.w;
+  lent = NULL;
+}
+
+void Segmenter::label(const cv::Mat &input, bool incremental)
+{
+  bool masked = true; // whether the labeling computes the masks of every pixel
+  if (p.sweep && p.engine != ENGINE_PYRAMID && p.budget.unlimited() && MergeTree::supports(input.type()))
+  {
+    masked = false;
+    if (!tree.builtFor(input, p.metric, p.connectivity))
+    {
+      PhaseTimer timer(rg.stats, PHASE_SIMILARITY);
+      tree.build(input, p.metric, p.connectivity);
+    }
+    PhaseTimer timer(rg.stats, PHASE_LABEL);
+    uint64_t rejected = 0;
+    rg.currentRegion = tree.labels(p.threshold, rg.passedBy, p.minRegion, &rejected);
+    REGGROW_STAT(rg.stats.rolledBack = rejected);
+    REGGROW_STAT(rg.stats.created = rg.currentRegion + rejected);
+  }
+  else
+    labelRegionGrow(&rg);
+  graphed = false;
+  if (p.mergeBelow > 0)
+  {
+    graph();
+    PhaseTimer timer(rg.stats, PHASE_MERGE);
+    rg.currentRegion = adjacency.mergeSmall(p.mergeBelow, rg.passedBy);
+  }
+  if (incremental && !rg.truncated)
+  {
+    restart(input, masked); // the regions grown again may not fit on 16 bits
+    return;
+  }
+  ref.release();
+  {
+    // labeled on 32 bits for want of a bound, stored on 16 when they fit
+    PhaseTimer timer(rg.stats, PHASE_LABEL);
+    rg.passedBy.narrow((uint32_t)rg.currentRegion);
+  }
+}
+
+const LabelMap &Segmenter::segment(const cv::Mat &im)
+{
+  RunStats conversion; // timed before the stats of the image are reset
+  cv::Mat input = convert(im, conversion);
+  bool incremental = incrementalMode();
+  if (incremental && !ref.empty() && input.size() == ref.size() && input.type() == ref.type() &&
+      update(input, conversion))
+    return rg.passedBy;
+
+  prepare(input, conversion);
+  label(input, incremental);
+  return rg.passedBy;
+}
+
+void Segmenter::restart(const cv::Mat &input, bool masked)
+{
+  if (!masked)
+  {
+    PhaseTimer timer(rg.stats, PHASE_SIMILARITY);
+    rg.similar.compute(input, p.threshold, p.metric, p.connectivity);
+  }
+  if (rg.nbh.size() != p.connectivity)
+    rg.nbh = Neighbourhood(rg.h, rg.w, p.connectivity);
+  input.copyTo(ref);
+  size_t n = (size_t)rg.h * rg.w;
+  if (stamp.size() != n)
+    stamp.assign(n, 0);
+  freeIds.clear();
+  topId = rg.currentRegion;
+}
+
+bool Segmenter::update(const cv::Mat &input, const RunStats &conversion)
+{
+  const int h = rg.h, w = rg.w;
+  RunStats compared; // timed before the stats of the image are reset
+  changed.clear();
+  {
+    PhaseTimer timer(compared, PHASE_SIMILARITY);
+    pickDiff(input.type(), p.metric)(input, ref, p.incremental, changed);
+  }
+  if (changed.size() > p.maxChanged * h * w)
+    return false;
+
+  rg.im = input;
+  rg.iterations = 0;
+  rg.truncated = false;
+  lent = NULL;
+  rg.stats.reset();
+  rg.stats.add(conversion);
+  rg.stats.add(compared);
+  graphed = false;
+  regrownPixels = 0;
+  if (changed.empty())
+    return true;
+  if (++frameNo == 0) // wrapped around, forget the old stamps
+  {
+    std::fill(stamp.begin(), stamp.end(), 0);
+    frameNo = 1;
+  }
+
+  // only the masks around the changed pixels can differ from the previous image
+  {
+    PhaseTimer timer(rg.stats, PHASE_SIMILARITY);
+    size_t bytes = ref.elemSize();
+    for (uint32_t idx : changed)
+      memcpy(ref.ptr((int)idx / w, (int)idx % w), input.ptr((int)idx / w, (int)idx % w), bytes);
+    rg.similar.update(ref, p.threshold, p.metric, p.connectivity, changed);
+  }
+
+  // a region may split if it contains a changed pixel, or merge with another
+  // one if it touches a changed pixel
+  PhaseTimer timer(rg.stats, PHASE_LABEL);
+  dirty.clear();
+  for (uint32_t idx : changed)
+  {
+    invalidate((int)idx);
+    rg.nbh.forEach((int)idx / w, (int)idx % w, [&](int, int, int nidx)
+    {
+      invalidate(nidx);
+      return true;
+    });
+  }
+  for (int idx : dirty)
+    regrow(idx);
+  compact();
+  return true;
+}
+
+void Segmenter::invalidate(int idx)
+{
+  LabelMap &labels = rg.passedBy;
+  uint32_t label = labels.get(idx);
+  if (label == 0)
+    return; // already invalidated
+  if (label == labels.maxLabel())
+  {
+    dirty.push_back(idx);
+    return;
+  }
+
+  const int w = rg.w;
+  labels.set(idx, 0);
+  rg.frontier.push(idx);
+  while (!rg.frontier.empty())
+  {
+    int q = rg.frontier.pop();
+    dirty.push_back(q);
+    rg.nbh.forEach(q / w, q % w, [&](int, int, int nidx)
+    {
+      if (labels.get(nidx) == label)
+      {
+        labels.set(nidx, 0);
+        rg.frontier.push(nidx);
+      }
+      return true;
+    });
+  }
+  freeIds.push_back(label);
+  rg.currentRegion--;
+}
+
+void Segmenter::regrow(int idx)
+{
+  LabelMap &labels = rg.passedBy;
+  const uint32_t marker = labels.maxLabel();
+  // rejected pixels are claimed again once per image, as their region may
+  // have grown past the minimum size
+  auto claimable = [&](int q)
+  {
+    uint32_t label = labels.get(q);
+    return label == 0 || (label == marker && stamp[q] != frameNo);
+  };
+  if (!claimable(idx))
+    return;
+
+  const int w = rg.w;
+  uint32_t id;
+  if (freeIds.empty())
+    id = ++topId;
+  else
+  {
+    id = freeIds.back();
+    freeIds.pop_back();
+  }
+  REGGROW_STAT(rg.stats.created++);
+
+  rg.journal.begin();
+  labels.set(idx, id);
+  stamp[idx] = frameNo;
+  rg.journal.record(idx);
+  rg.frontier.push(idx);
+  while (!rg.frontier.empty())
+  {
+    int q = rg.frontier.pop();
+    rg.iterations++;
+    rg.nbh.forEachIn(q / w, q % w, rg.similar.bits(q), [&](int, int, int nidx)
+    {
+      if (claimable(nidx))
+      {
+        labels.set(nidx, id);
+        stamp[nidx] = frameNo;
+        rg.journal.record(nidx);
+        rg.frontier.push(nidx);
+      }
+      return true;
+    });
+  }
+
+  regrownPixels += rg.journal.size();
+  if (p.minRegion > 0 && (int)rg.journal.size() < p.minRegion)
+  {
+    labels.rollback(rg.journal, marker);
+    freeIds.push_back(id);
+    REGGROW_STAT(rg.stats.rolledBack++);
+    return;
+  }
+  rg.currentRegion++;
+}
+
+void Segmenter::compact()
+{
+  // every number above the count of regions in use moves to a free number below it
+  const uint32_t regions = (uint32_t)rg.currentRegion;
+  if (topId > regions)
+  {
+    std::sort(freeIds.begin(), freeIds.end());
+    std::vector<uint32_t> renumber(topId - regions + 1, 0);
+    size_t hole = 0, next = std::lower_bound(freeIds.begin(), freeIds.end(), regions + 1) - freeIds.begin();
+    for (uint32_t id = regions + 1; id <= topId; id++)
+    {
+      if (next < freeIds.size() && freeIds[next] == id)
+        next++;
+      else
+        renumber[id - regions] = freeIds[hole++];
+    }
+    LabelMap &labels = rg.passedBy;
+    for (int idx = 0; idx < rg.h * rg.w; idx++)
+    {
+      uint32_t label = labels.get(idx);
+      if (label > regions && label <= topId)
+        labels.set(idx, renumber[label - regions]);
+    }
+    topId = regions;
+  }
+  freeIds.clear();
+}
+
+const RegionGraph &Segmenter::graph()
+{
+  if (!graphed)
+  {
+    PhaseTimer timer(rg.stats, PHASE_MERGE);
+    adjacency.build(lent ? *lent : rg.passedBy, rg.im, p.connectivity);
+    graphed = true;
+  }
+  return adjacency;
+}
+
+int Segmenter::segment(const cv::Mat &im, LabelMap &labels)
+{
+  if (incrementalMode())
+  {
+    segment(im).copyTo(labels); // the labels stay here, as the reference of the next image
+    return rg.currentRegion;
+  }
+
+  RunStats conversion; // timed before the stats of the image are reset
+  cv::Mat input = convert(im, conversion);
+  prepare(input, conversion);
+  labels.reset(rg.h, rg.w, (size_t)rg.h * rg.w);
+  {
+    LabelLender lender(rg.passedBy, labels);
+    label(input, false);
+  }
+  lent = &labels;
+  return rg.currentRegion;
+}
+
+const cv::Mat &Segmenter::colorize()
+{
+  if (lent)
+  {
+    LabelLender lender(rg.passedBy, *lent);
+    colorRegionGrow(&rg);
+  }
+  else
+    colorRegionGrow(&rg);
+  return rg.SEGS;
+}
+
+LabelMap segment(const cv::Mat &im, const SegmentParams &params)
+{
+  Segmenter segmenter(params);
+  LabelMap labels;
+  segmenter.segment(im, labels);
+  return labels;
+}
@@ -0,0 +1,310 @@
+#ifndef REGGROW_HPP
+#define REGGROW_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <vector>
+#include "color_space.hpp"
+#include "frontier.hpp"
+#include "label_map.hpp"
+#include "merge_tree.hpp"
+#include "region_graph.hpp"
+#include "region_grow.hpp"
+#include "scan_label.hpp"
+
+/**
+ * @brief Parameters of a segmentation
+ */
+struct SegmentParams
+{
+  float threshold = 12;              // color distance below which neighbours join a region
+  int minRegion = 0;                 // regions smaller than this are rejected (0 keeps all)
+  int threads = 1;                   // > 1 to label parallel tiles
+  LabelEngine engine = ENGINE_FLOOD; // algorithm labeling the pixels
+  FrontierOrder order = ORDER_LIFO;  // visiting order of the serial flood fill
+  int mergeBelow = 0;                // regions smaller than this join their most similar neighbour (0 keeps all)
+  int pyramidLevels = 3;             // coarser levels of ENGINE_PYRAMID
+  ColorMetric metric = METRIC_L2;    // distance between two pixels
+  int connectivity = 8;              // 4 or 8
+  ColorSpace colorSpace = SPACE_BGR; // space the pixels are converted to before labeling
+  GrowBudget budget;                 // deadline and pixel budget of the serial flood fill, none by default
+  bool sweep = false;                // keep a MergeTree of the image for the next thresholds
+  double incremental = -1;           // color distance past which a pixel is grown again in the next image (-1 for none)
+  double maxChanged = 0.25;          // fraction of changed pixels above which an image is segmented fully
+};
+
+/**
+ * @brief Segmenter of images, reusing its memory from one call to the next
+ *
+ * The entry point of libreggrow. The buffers of the first image (see
+ * `initRegionGrow()`) are kept and reused by every next image of the same
+ * size, so an in-process caller pays neither a process spawn nor a buffer
+ * allocation per image. Images are read in place: any Mat of 1, 3 or 4
+ * channels of 8-bit, 16-bit or float pixels can be passed, including a view of the caller's memory or a region of interest
+ * of a larger image, and it is neither copied nor modified.
+ *
+ * A Segmenter is not thread-safe; use one per thread.
+ */
+class Segmenter
+{
+public:
+  explicit Segmenter(const SegmentParams &params = SegmentParams());
+
+  ~Segmenter();
+
+  Segmenter(const Segmenter &) = delete;
+  Segmenter &operator=(const Segmenter &) = delete;
+
+  /**
+   * @brief Label the regions of an image
+   *
+   * @param im The image, which must stay valid until the next call
+   *
+   * @return The labels: 1..n for the regions in raster order of their first
+   * pixel, `maxLabel()` for the pixels of rejected regions. They are valid
+   * until the next call, which overwrites them. They are stored on 16 bits
+   * whenever n + 1 fits below 65535, whatever the size of the image (see
+   * `LabelMap::narrow()`), and on 32 bits otherwise.
+   *
+   * The image is first converted to `colorSpace`, unless it is the image of
+   * the previous call in the same space, whose conversion is reused (see
+   * `ColorCache`): a threshold sweep over one image with `setParams()`
+   * converts it once. The threshold, the metric and the mean colors of
+   * `graph()` are then in the units of the color space.
+   *
+   * Regions smaller than `minRegion` are rejected first; regions smaller than
+   * `mergeBelow` are then merged into their most similar neighbour with
+   * `RegionGraph::mergeSmall()`.
+   *
+   * With a `budget`, the serial flood fill stops when it runs out, and the
+   * pixels it did not reach are labeled `maxLabel()`, see `truncated()` and
+   * `labelRegionGrow()`.
+   *
+   * With `sweep`, the first call on an image builds its `MergeTree`, and
+   * every call on the same image, metric and connectivity labels it from the
+   * tree in one pass, whatever the threshold. The labels are those of the
+   * serial flood fill. The pyramid engine, a budget and images other than
+   * 8-bit ones label every threshold from scratch instead.
+   *
+   * With an `incremental` tolerance, for the frames of a sequence, an image
+   * of the size and type of the previous one is compared to the reference
+   * colors the current labels were grown from, and only the regions
+   * containing or touching a pixel whose color moved past the tolerance are
+   * grown again, serially; every other label is kept. With a tolerance of 0
+   * the regions are those a full segmentation would find. The image is
+   * segmented fully instead when more than `maxChanged` of its pixels
+   * changed, after `setParams()`, with `mergeBelow`, with the pyramid engine,
+   * whose regions are approximate and may hold one label on disconnected
+   * parts, and after an image that ran out of budget; growing again is not
+   * bounded by the budget. The labels then stay on 32 bits, and regions grown again take
+   * the numbers of the regions they replace, so that they are 1..n but not
+   * in raster order.
+   */
+  const LabelMap &segment(const cv::Mat &im);
+
+  /**
+   * @brief Label the regions of an image into the caller's label map
+   *
+   * @param im The image
+   * @param labels Receives the labels, see `segment(const cv::Mat &)`. If it
+   * already has the size of the image and the label width of
+   * `labelBytes(im.rows, im.cols)`, for instance when created on the caller's
+   * memory, the image is labeled in place, in the next epoch of the map (see
+   * `LabelMap::mat()`); otherwise it is allocated again. It must stay valid
+   * for `colorize()` and `graph()` of this image, which read it.
+   *
+   * @return The number of regions
+   *
+   * In incremental mode the labels stay in the Segmenter, as the reference of
+   * the next image, and are copied to `labels`.
+   */
+  int segment(const cv::Mat &im, LabelMap &labels);
+
+  /**
+   * @brief Color the regions of the last image
+   *
+   * @return The segmented image, one color per region and white for rejected
+   * pixels, valid until the next call to `segment()`
+   */
+  const cv::Mat &colorize();
+
+  /**
+   * @brief Region adjacency graph of the last image
+   *
+   * @return The regions, with their area, bounding box and mean color, and
+   * their neighbours; built by the first call after `segment()`, unless the
+   * regions were merged, which builds it already
+   */
+  const RegionGraph &graph();
+
+  /**
+   * @brief Number of regions of the last image
+   */
+  int regions() const
+  {
+    return rg.currentRegion;
+  }
+
+  /**
+   * @brief Whether the budget ran out on the last image, leaving pixels labeled `maxLabel()`
+   */
+  bool truncated() const
+  {
+    return rg.truncated;
+  }
+
+  /**
+   * @brief Number of pixels grown again by the last image, every pixel unless it was segmented incrementally
+   */
+  size_t regrown() const
+  {
+    return regrownPixels;
+  }
+
+  /**
+   * @brief Counters and phase times of the last image, see `RunStats`
+   *
+   * Reset by every `segment()`; `colorize()` and `graph()` add to them.
+   */
+  const RunStats &stats() const
+  {
+    return rg.stats;
+  }
+
+  /**
+   * @brief The parameters
+   */
+  const SegmentParams &params() const
+  {
+    return p;
+  }
+
+  /**
+   * @brief Change the parameters of the next images
+   *
+   * The buffers and the converted image are kept, so that segmenting the
+   * same image again, for instance with another threshold, neither
+   * allocates nor converts it again. The next image is segmented fully.
+   */
+  void setParams(const SegmentParams &params)
+  {
+    p = params;
+    ref.release();
+  }
+
+  /**
+   * @brief Forget the converted image and its merge tree, after writing new pixels in the memory of the last image
+   */
+  void forgetImage()
+  {
+    colors.clear();
+    tree.clear();
+  }
+
+  /**
+   * @brief Bytes of a label map receiving the labels of an h x w image
+   *
+   * Create it with `labels.create(h, w, (size_t)h * w, storage)` on that much
+   * caller memory to get the labels without any allocation.
+   */
+  static size_t labelBytes(int h, int w)
+  {
+    return LabelMap::storageBytes(h, w, (size_t)h * w);
+  }
+
+private:
+  /**
+   * @brief Convert an image to the color space of the labeling
+   */
+  cv::Mat convert(const cv::Mat &im, RunStats &conversion);
+
+  /**
+   * @brief Initialize or reuse the buffers for an image and apply the parameters
+   */
+  void prepare(const cv::Mat &input, const RunStats &conversion);
+
+  /**
+   * @brief Label a prepared image into `rg.passedBy`, then narrow the labels or take them as the incremental reference
+   */
+  void label(const cv::Mat &input, bool incremental);
+
+  /**
+   * @brief Whether the parameters let images be segmented incrementally, see `segment()`
+   */
+  bool incrementalMode() const
+  {
+    return p.incremental >= 0 && p.mergeBelow <= 0 && p.engine != ENGINE_PYRAMID;
+  }
+
+  /**
+   * @brief Segment an image incrementally, see `segment()`
+   *
+   * @param input The image in the color space of the labeling
+   * @param conversion Stats of its conversion
+   *
+   * @return False if too many pixels changed, nothing is modified then
+   */
+  bool update(const cv::Mat &input, const RunStats &conversion);
+
+  /**
+   * @brief Reset the labels of the region containing a pixel to 0
+   *
+   * Rejected pixels, which do not belong to a labeled region, are only
+   * queued for growth. A label is one connected region, as every engine
+   * but the pyramid labels them, so that clearing the pixels connected to
+   * this one frees its number.
+   */
+  void invalidate(int idx);
+
+  /**
+   * @brief Grow a region again from a pixel of an invalidated region
+   */
+  void regrow(int idx);
+
+  /**
+   * @brief Renumber the regions 1..n after an update left gaps in the numbers
+   */
+  void compact();
+
+  /**
+   * @brief Take a full segmentation as the reference of the next incremental images
+   *
+   * @param input The image in the color space of the labeling
+   * @param masked Whether its labeling computed the similarity masks of every pixel
+   */
+  void restart(const cv::Mat &input, bool masked);
+
+  SegmentParams p;
+  RegionGrow rg;
+  bool started = false;  // whether rg has been initialized by an image
+  RegionGraph adjacency;
+  bool graphed = false;  // whether adjacency is the graph of the last image
+  ColorCache colors;     // the last image in the color space of the labeling
+  MergeTree tree;        // merges of the last image, with sweep
+  LabelMap *lent = NULL; // caller's map holding the labels of the last image, NULL for rg.passedBy
+
+  // incremental mode
+  cv::Mat ref;                    // colors the labels were grown from, empty to segment the next image fully
+  std::vector<uint32_t> stamp;    // image number at which a pixel was last grown
+  uint32_t frameNo = 0;
+  std::vector<uint32_t> changed;  // pixels of the image past the tolerance
+  std::vector<int> dirty;         // pixels of the invalidated regions
+  std::vector<uint32_t> freeIds;  // region numbers of the invalidated regions
+  uint32_t topId = 0;             // largest region number in use
+  size_t regrownPixels = 0;
+};
+
+/**
+ * @brief Label the regions of an image, see `Segmenter::segment()`
+ *
+ * @param im The image, see `Segmenter`
+ * @param params The parameters
+ *
+ * @return The labels, in a map of their own
+ *
+ * Allocates the buffers for this image only: use a Segmenter to segment
+ * several images.
+ */
+LabelMap segment(const cv::Mat &im, const SegmentParams &params = SegmentParams());
+
+#endif
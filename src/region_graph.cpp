@@ -0,0 +1,210 @@
+#include "region_graph.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <numeric>
+#include "union_find.hpp"
+
+void RegionGraph::build(const LabelMap &labels, const cv::Mat &im, int connectivity)
+{
+  CV_Assert(connectivity == 4 || connectivity == 8);
+  const int h = im.rows, w = im.cols;
+  const uint32_t marker = labels.maxLabel();
+  auto inRegion = [&](uint32_t l) { return l != 0 && l != marker; };
+
+  info.assign(1, RegionInfo());
+  edgeList.clear();
+  Edge last = {0, 0};
+  auto addEdge = [&](uint32_t l, uint32_t m)
+  {
+    if (l == m || !inRegion(m))
+      return;
+    Edge e = l < m ? Edge{l, m} : Edge{m, l};
+    if (e.a != last.a || e.b != last.b) // boundaries run along rows, skip the repeats
+      edgeList.push_back(e);
+    last = e;
+  };
+
+  const int cn = im.channels(), summed = std::min(cn, 3);
+  cv::Mat converted; // a row of an image other than CV_8UC3, as doubles
+  for (int x = 0; x < h; x++)
+  {
+    const uchar *row = NULL;
+    const double *rowd = NULL;
+    if (im.type() == CV_8UC3)
+      row = im.ptr<uchar>(x);
+    else
+    {
+      im.row(x).convertTo(converted, CV_64F);
+      rowd = converted.ptr<double>();
+    }
+    for (int y = 0; y < w; y++)
+    {
+      uint32_t l = labels.get(x, y);
+      if (!inRegion(l))
+        continue;
+      if (l >= info.size())
+        info.resize(l + 1);
+      RegionInfo &r = info[l];
+      if (r.area == 0)
+      {
+        r.x0 = r.x1 = x;
+        r.y0 = r.y1 = y;
+      }
+      else
+      {
+        r.x1 = x; // rows are scanned in order
+        r.y0 = std::min(r.y0, y);
+        r.y1 = std::max(r.y1, y);
+      }
+      r.area++;
+      for (int c = 0; c < summed; c++)
+        r.sum[c] += row ? row[3 * y + c] : rowd[cn * y + c];
+
+      if (y + 1 < w)
+        addEdge(l, labels.get(x, y + 1));
+      if (x + 1 < h)
+      {
+        if (connectivity == 8 && y > 0)
+          addEdge(l, labels.get(x + 1, y - 1));
+        addEdge(l, labels.get(x + 1, y));
+        if (connectivity == 8 && y + 1 < w)
+          addEdge(l, labels.get(x + 1, y + 1));
+      }
+    }
+  }
+  buildAdjacency();
+}
+
+void RegionGraph::buildAdjacency()
+{
+  std::sort(edgeList.begin(), edgeList.end(), [](const Edge &e, const Edge &f)
+  {
+    return e.a != f.a ? e.a < f.a : e.b < f.b;
+  });
+  edgeList.erase(std::unique(edgeList.begin(), edgeList.end(), [](const Edge &e, const Edge &f)
+  {
+    return e.a == f.a && e.b == f.b;
+  }), edgeList.end());
+
+  offsets.assign(info.size() + 1, 0);
+  for (const Edge &e : edgeList)
+  {
+    offsets[e.a + 1]++;
+    offsets[e.b + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  adjacent.resize(2 * edgeList.size());
+  std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+  // the edges are sorted by a then b: the smaller neighbours of a region
+  // come in increasing order from the first loop, then the larger ones from
+  // the second, so every list is sorted
+  for (const Edge &e : edgeList)
+    adjacent[fill[e.b]++] = e.a;
+  for (const Edge &e : edgeList)
+    adjacent[fill[e.a]++] = e.b;
+}
+
+int RegionGraph::mergeSmall(size_t min_area, LabelMap &labels)
+{
+  const uint32_t n = size();
+  std::vector<double> dist(edgeList.size());
+  for (size_t i = 0; i < edgeList.size(); i++)
+  {
+    cv::Vec3d d = info[edgeList[i].a].mean() - info[edgeList[i].b].mean();
+    dist[i] = d.dot(d);
+  }
+  std::vector<size_t> order(edgeList.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) { return dist[i] < dist[j]; });
+
+  UnionFind sets;
+  sets.resize(n);
+  std::vector<size_t> area(n + 1);
+  for (uint32_t l = 1; l <= n; l++)
+    area[l] = info[l].area;
+  for (size_t i : order)
+  {
+    uint32_t a = sets.find(edgeList[i].a), b = sets.find(edgeList[i].b);
+    if (a == b || (area[a] >= min_area && area[b] >= min_area))
+      continue;
+    sets.unite(a, b);
+    area[sets.find(a)] = area[a] + area[b];
+  }
+
+  // roots are the smallest label of their set, so they come first
+  std::vector<uint32_t> relabel(n + 1, 0);
+  uint32_t regions = 0;
+  for (uint32_t l = 1; l <= n; l++)
+  {
+    if (info[l].area == 0)
+      continue;
+    uint32_t root = sets.find(l);
+    if (root == l)
+      relabel[l] = ++regions;
+    else
+      relabel[l] = relabel[root];
+  }
+
+  const uint32_t marker = labels.maxLabel();
+  const int total = labels.mat().rows * labels.mat().cols;
+  for (int idx = 0; idx < total; idx++)
+  {
+    uint32_t l = labels.get(idx);
+    if (l != 0 && l != marker && relabel[l] != l)
+      labels.set(idx, relabel[l]);
+  }
+
+  std::vector<RegionInfo> merged(regions + 1);
+  for (uint32_t l = 1; l <= n; l++)
+  {
+    const RegionInfo &r = info[l];
+    if (r.area == 0)
+      continue;
+    RegionInfo &m = merged[relabel[l]];
+    if (m.area == 0)
+      m = r;
+    else
+    {
+      m.area += r.area;
+      m.sum += r.sum;
+      m.x0 = std::min(m.x0, r.x0);
+      m.y0 = std::min(m.y0, r.y0);
+      m.x1 = std::max(m.x1, r.x1);
+      m.y1 = std::max(m.y1, r.y1);
+    }
+  }
+  info.swap(merged);
+
+  size_t kept = 0;
+  for (const Edge &e : edgeList)
+  {
+    uint32_t a = relabel[e.a], b = relabel[e.b];
+    if (a != b)
+      edgeList[kept++] = a < b ? Edge{a, b} : Edge{b, a};
+  }
+  edgeList.resize(kept);
+  buildAdjacency();
+  return (int)regions;
+}
+
+bool RegionGraph::writeCsv(const std::string &path) const
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f)
+    return false;
+  fprintf(f, "label,area,x,y,width,height,b,g,r,neighbours\n");
+  for (uint32_t l = 1; l <= size(); l++)
+  {
+    const RegionInfo &r = info[l];
+    if (r.area == 0)
+      continue;
+    cv::Rect box = r.bbox();
+    cv::Vec3d mean = r.mean();
+    fprintf(f, "%u,%zu,%d,%d,%d,%d,%.2f,%.2f,%.2f,", l, r.area, box.x, box.y, box.width, box.height, mean[0],
+            mean[1], mean[2]);
+    for (size_t k = 0; k < degree(l); k++)
+      fprintf(f, k == 0 ? "%u" : " %u", neighbours(l)[k]);
+    fprintf(f, "\n");
+  }
+  return fclose(f) == 0;
+}
@@ -0,0 +1,162 @@
+#ifndef REGION_GRAPH_HPP
+#define REGION_GRAPH_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "label_map.hpp"
+
+/**
+ * @brief Statistics of a region of a label map
+ */
+struct RegionInfo
+{
+  size_t area = 0;       // number of pixels
+  cv::Vec3d sum;         // sum of the pixel colors
+  int x0 = 0, y0 = 0;    // first row and column of the bounding box
+  int x1 = -1, y1 = -1;  // last row and column of the bounding box
+
+  /**
+   * @brief Mean color of the region, or zeros if it is empty
+   */
+  cv::Vec3d mean() const
+  {
+    return area == 0 ? cv::Vec3d() : sum * (1.0 / area);
+  }
+
+  /**
+   * @brief Bounding box of the region, as a cv::Rect (x is the column)
+   */
+  cv::Rect bbox() const
+  {
+    return cv::Rect(y0, x0, y1 - y0 + 1, x1 - x0 + 1);
+  }
+};
+
+/**
+ * @brief Region adjacency graph of a label map
+ *
+ * The nodes are the labels 1..size() of the regions, with their area,
+ * bounding box and mean color; two regions are adjacent when two of their
+ * pixels are neighbours, 4- or 8-connected like the labeling. Unassigned
+ * pixels (label 0) and rejected pixels (`maxLabel()`) belong to no region.
+ * The graph is built in a single scan of the label map and the image, so
+ * that consumers get the regions and their neighbours without scanning the
+ * full-resolution labels again.
+ */
+class RegionGraph
+{
+public:
+  // an edge between two adjacent regions
+  struct Edge
+  {
+    uint32_t a, b; // labels of the regions, a < b
+  };
+
+  RegionGraph() : info(1), offsets(2, 0) {}
+
+  /**
+   * @brief Build the graph of a label map
+   *
+   * @param labels The labels
+   * @param im The image the labels were grown from; the mean color holds its
+   * first three channels, or its only channel in the first one
+   * @param connectivity 4 or 8, that of the labeling: regions touching only
+   * at a corner are not adjacent at 4
+   *
+   * Every pixel is compared to its right and bottom neighbours, and at 8 to
+   * its bottom-left and bottom-right ones, which covers every pair once. The
+   * edges are then sorted and deduplicated into adjacency lists.
+   */
+  void build(const LabelMap &labels, const cv::Mat &im, int connectivity = 8);
+
+  /**
+   * @brief Merge every region smaller than a size into its most similar neighbour
+   *
+   * @param min_area Minimum number of pixels of a region
+   * @param labels The labels the graph was built from, relabeled in place
+   *
+   * @return The number of regions after merging
+   *
+   * The edges are visited by increasing distance between the mean colors of
+   * their regions, and the two regions of an edge are merged, with a
+   * union-find over the regions, while either of them is smaller than
+   * `min_area`. A small region thus joins its most similar neighbour, or the
+   * region its most similar neighbour joined. Regions without any neighbour
+   * are kept whatever their size. The merged regions are numbered 1..n by the
+   * raster order of their first pixel, as the labelers number them, and the
+   * graph is updated to the merged regions without scanning the labels again:
+   * only the relabeling pass reads and writes them.
+   */
+  int mergeSmall(size_t min_area, LabelMap &labels);
+
+  /**
+   * @brief Largest label; the regions are 1..size(), some possibly empty
+   */
+  uint32_t size() const
+  {
+    return (uint32_t)info.size() - 1;
+  }
+
+  /**
+   * @brief Statistics of a region
+   *
+   * @param label The label of the region, in 1..size()
+   */
+  const RegionInfo &region(uint32_t label) const
+  {
+    return info[label];
+  }
+
+  /**
+   * @brief The edges, sorted by (a, b)
+   */
+  const std::vector<Edge> &edges() const
+  {
+    return edgeList;
+  }
+
+  /**
+   * @brief Number of regions adjacent to a region
+   */
+  size_t degree(uint32_t label) const
+  {
+    return offsets[label + 1] - offsets[label];
+  }
+
+  /**
+   * @brief Labels of the `degree(label)` regions adjacent to a region, in increasing order
+   */
+  const uint32_t *neighbours(uint32_t label) const
+  {
+    return adjacent.data() + offsets[label];
+  }
+
+  /**
+   * @brief Write the regions and their neighbours as CSV
+   *
+   * @param path Path of the output file
+   *
+   * @return False if the file cannot be written
+   *
+   * One line per non-empty region: its label, area, bounding box (column,
+   * row, width, height), mean color (blue, green, red) and the labels of its
+   * neighbours separated by spaces.
+   */
+  bool writeCsv(const std::string &path) const;
+
+private:
+  /**
+   * @brief Sort and deduplicate edgeList, and build the adjacency lists from it
+   */
+  void buildAdjacency();
+
+  std::vector<RegionInfo> info;  // indexed by label, 0 is unused
+  std::vector<Edge> edgeList;
+  std::vector<size_t> offsets;   // adjacency list of label l is adjacent[offsets[l], offsets[l + 1])
+  std::vector<uint32_t> adjacent;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "region_grow.hpp"
+#include "color_distance.hpp"
+#include "ocl_grow.hpp"
+#include "pyramid_grow.hpp"
+#include "tiled_grow.hpp"
+
+using namespace cv;
+
+/**
+ * @brief Carve the per-image buffers of a RegionGrow object from its arena
+ *
+ * Sizes the arena for an h x w image and places the passedBy labels, the
+ * frontier, the journal, the similarity masks and SEGS in it. passedBy is
+ * all zeros, SEGS is not initialized.
+ */
+static void carveRegionGrow(RegionGrow *rg)
+{
+  size_t n = (size_t)rg->h * rg->w; // every pixel may start its own region
+  size_t labelBytes = LabelMap::storageBytes(rg->h, rg->w, n);
+  size_t bytes = Arena::footprint<uint8_t>(labelBytes) + 2 * Arena::footprint<uint32_t>(n) +
+                 Arena::footprint<uint8_t>(n) + Arena::footprint<Vec3b>(n);
+  rg->arena.reserve(bytes, bytes >= Arena::HUGE_PAGE);
+
+  rg->passedBy.create(rg->h, rg->w, n, rg->arena.alloc<uint8_t>(labelBytes));
+  rg->frontier.attach(rg->arena.alloc<uint32_t>(n), n); // every pixel is pushed at most once
+  rg->journal.attach(rg->arena.alloc<int>(n), n);
+  rg->similar.attach(rg->arena.alloc<uint8_t>(n), rg->h, rg->w);
+  rg->SEGS = Mat(rg->h, rg->w, CV_8UC3, rg->arena.alloc<Vec3b>(n));
+}
+
+void initRegionGrow(RegionGrow *rg, const Mat &im, float th, int min_region, int threads,
+                    LabelEngine engine)
+{
+  rg->im = im;
+  rg->h = rg->im.rows;
+  rg->w = rg->im.cols;
+  carveRegionGrow(rg);
+  rg->currentRegion = 0;
+  rg->iterations = 0;
+  rg->stats.reset();
+  rg->SEGS.setTo(0); // initializes the SEGS Mat to zeros
+  rg->thresh = th;
+  rg->minRegion = min_region;
+  rg->metric = METRIC_L2;
+  rg->connectivity = 8;
+  rg->nbh = Neighbourhood(rg->h, rg->w, rg->connectivity);
+  rg->threads = threads;
+  rg->engine = engine;
+  rg->levels = 3;
+  rg->budget = GrowBudget();
+  rg->truncated = false;
+}
+
+void reuseRegionGrow(RegionGrow *rg, const Mat &im)
+{
+  rg->im = im;
+  if (im.rows != rg->h || im.cols != rg->w)
+  {
+    rg->h = im.rows;
+    rg->w = im.cols;
+    rg->nbh = Neighbourhood(rg->h, rg->w, rg->connectivity);
+    carveRegionGrow(rg); // SEGS is fully rewritten by colorRegionGrow
+  }
+  else
+  {
+    rg->passedBy.nextEpoch();
+    rg->frontier.clear();
+  }
+  rg->currentRegion = 0;
+  rg->iterations = 0;
+  rg->stats.reset();
+  rg->truncated = false;
+}
+
+void freeRegionGrow(RegionGrow *rg)
+{
+  rg->passedBy.release();
+  rg->SEGS.release();
+  rg->similar = SimilarityMap();
+  rg->frontier = Frontier();
+  rg->journal = RegionJournal();
+  rg->arena.release();
+}
+
+void BFS(RegionGrow *rg, int x0, int y0)
+{
+  uint32_t regionNum = rg->passedBy.get(x0, y0);
+  GrowCounters counters;
+  counters.frontier(rg->frontier.size());
+
+  while (!rg->frontier.empty())
+  {
+    if (!rg->work.spend())
+    {
+      rg->frontier.clear(); // already labeled, left unvisited
+      break;
+    }
+    int idx = rg->frontier.pop();
+    rg->iterations++;
+    counters.pop();
+
+    rg->nbh.forEachIn(idx / rg->w, idx % rg->w, rg->similar.bits(idx), [&](int, int, int nidx)
+    {
+      if (counters.test(rg->passedBy.get(nidx) == 0))
+      {
+        rg->passedBy.set(nidx, regionNum);
+        if (rg->minRegion > 0)
+          rg->journal.record(nidx);
+        rg->frontier.push(nidx); // add neighbor to the frontier
+        counters.frontier(rg->frontier.size());
+      }
+      return true;
+    });
+  }
+  rg->stats.grow.add(counters);
+}
+
+void rejectRegion(RegionGrow *rg)
+{
+  rg->passedBy.rollback(rg->journal, rg->passedBy.maxLabel());
+  rg->currentRegion--;
+  REGGROW_STAT(rg->stats.rolledBack++);
+}
+
+/**
+ * @brief Label every pixel not labeled yet from a linear index on as unvisited
+ *
+ * Pixels before the index were all labeled by the scan of `labelRegionGrow`.
+ */
+static void markUnvisited(RegionGrow *rg, int from)
+{
+  uint64_t unvisited = 0;
+  for (int idx = from; idx < rg->h * rg->w; idx++)
+  {
+    if (rg->passedBy.get(idx) == 0)
+    {
+      rg->passedBy.set(idx, rg->passedBy.maxLabel());
+      unvisited++;
+    }
+  }
+  rg->truncated = true;
+  REGGROW_STAT(rg->stats.capHit = true);
+  REGGROW_STAT(rg->stats.unvisited = unvisited);
+}
+
+void labelRegionGrow(RegionGrow *rg)
+{
+  rg->work.start(rg->budget);
+  rg->truncated = false;
+  if (rg->nbh.size() != rg->connectivity)
+    rg->nbh = Neighbourhood(rg->h, rg->w, rg->connectivity);
+  if (rg->engine == ENGINE_OPENCL && rg->im.type() == CV_8UC3 && rg->metric == METRIC_L2)
+  {
+    PhaseTimer timer(rg->stats, PHASE_LABEL);
+    int regions = growOpenCL(rg->im.getUMat(ACCESS_READ), squaredThreshold(rg->thresh), rg->nbh.mask(),
+                             rg->passedBy, rg->minRegion, &rg->similar);
+    if (regions >= 0)
+    {
+      rg->currentRegion = regions;
+      REGGROW_STAT(rg->stats.created = regions);
+      return;
+    }
+  }
+  if (rg->engine == ENGINE_PYRAMID)
+  {
+    // computes the similarity of the pixels it needs, level by level
+    PhaseTimer timer(rg->stats, PHASE_LABEL);
+    rg->currentRegion = growPyramid(rg->im, rg->nbh, rg->thresh, rg->metric, rg->levels, rg->passedBy,
+                                    rg->minRegion, rg->similar, rg->frontier.data());
+    REGGROW_STAT(rg->stats.created = rg->currentRegion);
+    return;
+  }
+  {
+    PhaseTimer timer(rg->stats, PHASE_SIMILARITY);
+    rg->similar.compute(rg->im, rg->thresh, rg->metric, rg->connectivity);
+  }
+
+  PhaseTimer timer(rg->stats, PHASE_LABEL);
+  if (rg->threads > 1 || rg->engine != ENGINE_FLOOD)
+  {
+    int tiles = 1;
+    if (rg->threads > 1)
+    {
+      setNumThreads(rg->threads);
+      tiles = 4 * rg->threads;
+    }
+    rg->currentRegion = growTiled(rg->similar, rg->nbh, rg->passedBy, rg->minRegion, tiles,
+                                  rg->engine == ENGINE_FLOOD ? ENGINE_FLOOD : ENGINE_SCAN, rg->frontier.data());
+    REGGROW_STAT(rg->stats.created = rg->currentRegion);
+  }
+  else
+  {
+    for (int x0 = 0; x0 < rg->h; x0++)
+    {
+      for (int y0 = 0; y0 < rg->w; y0++)
+      {
+        if (rg->passedBy.get(x0, y0) == 0)
+        {
+          rg->currentRegion++;
+          REGGROW_STAT(rg->stats.created++);
+          rg->passedBy.set(x0, y0, rg->currentRegion);
+          rg->frontier.push(x0 * rg->w + y0);
+          if (rg->minRegion > 0)
+          {
+            rg->journal.begin();
+            rg->journal.record(x0 * rg->w + y0);
+          }
+          BFS(rg, x0, y0);
+          if (rg->minRegion > 0 && (int)rg->journal.size() < rg->minRegion)
+            rejectRegion(rg);
+          if (rg->work.exhausted())
+          {
+            markUnvisited(rg, x0 * rg->w + y0);
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+Vec3b regionColor(const LabelMap &labels, uint32_t label)
+{
+  return label == 0 || label == labels.maxLabel() ? Vec3b(255, 255, 255) : labelColor(label);
+}
+
+void colorRegionGrow(RegionGrow *rg)
+{
+  PhaseTimer timer(rg->stats, PHASE_COLORIZE);
+  for (int i = 0; i < rg->h; i++)
+  {
+    for (int j = 0; j < rg->w; j++)
+      rg->SEGS.at<Vec3b>(i, j) = regionColor(rg->passedBy, rg->passedBy.get(i, j));
+  }
+}
+
+void ApplyRegionGrow(RegionGrow *rg)
+{
+  labelRegionGrow(rg);
+  colorRegionGrow(rg);
+}
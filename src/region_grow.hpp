@@ -0,0 +1,199 @@
+#ifndef REGION_GROW_HPP
+#define REGION_GROW_HPP
+
+#include <opencv2/opencv.hpp>
+#include "arena.hpp"
+#include "frontier.hpp"
+#include "label_map.hpp"
+#include "neighbourhood.hpp"
+#include "region_journal.hpp"
+#include "run_stats.hpp"
+#include "scan_label.hpp"
+#include "similarity_map.hpp"
+#include "work_budget.hpp"
+
+typedef struct RegionGrow
+{
+  cv::Mat im;            // original image
+  int h, w;          // height and width
+  LabelMap passedBy; // which pixels have already been processed
+  int currentRegion; // current region number
+  int iterations;
+  cv::Mat SEGS;     // stores the segmented image
+  Frontier frontier; // pixels waiting to be visited
+  float thresh; // threshold
+  int minRegion;         // regions smaller than this are rejected (0 keeps all)
+  RegionJournal journal; // pixels claimed by the current region
+  Neighbourhood nbh;     // neighbour offsets (8-connectivity)
+  SimilarityMap similar; // which neighbours are within the threshold
+  int threads;           // > 1 to grow tiles of the image in parallel
+  LabelEngine engine;    // algorithm labeling the pixels
+  int levels;            // coarser pyramid levels of ENGINE_PYRAMID
+  ColorMetric metric;    // distance between two pixels
+  int connectivity;      // 4 or 8
+  Arena arena;           // memory of passedBy, frontier, journal, similar and SEGS
+  RunStats stats;        // counters and phase times of the current image
+  GrowBudget budget;     // deadline and pixel budget of the serial flood fill, none by default
+  WorkBudget work;       // budget being spent by the current image
+  bool truncated;        // the budget ran out before every pixel was labeled
+} RegionGrow;
+
+/**
+ * @brief Initialize a RegionGrow object
+ *
+ * @param rg Pointer to a RegionGrow object to initialize
+ * @param im The image to process, of 1, 3 or 4 channels of 8-bit, 16-bit or
+ * float pixels (see `SimilarityMap::supports()`)
+ * @param th Threshold value for region growing
+ * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+ * @param threads Number of threads, 1 for the serial scan
+ * @param engine Algorithm labeling the pixels
+ *
+ * Initializes a RegionGrow object with the given image and threshold.
+ * It keeps a reference to the image, sets the height and width of the image,
+ * and carves the passedBy label map, a frontier for all h * w pixels in LIFO
+ * order, the journal, the similarity masks and SEGS out of a single arena sized
+ * from h * w, backed by transparent huge pages when it spans at least one. It
+ * initializes the currentRegion, iterations and stats to 0, initializes the SEGS Mat
+ * to zeros, sets the threshold, the minimum region size, the number of threads
+ * and the engine, uses 3 coarser levels for the pyramid engine and no budget, and precomputes the 8-connected neighbourhood of the image
+ * with the Euclidean metric. Set `metric` and `connectivity` after
+ * initialization to compare pixels otherwise.
+ * Call `rg->frontier.setOrder()` after initialization to visit pixels in FIFO
+ * order instead; the labels are the same.
+ */
+void initRegionGrow(RegionGrow *rg, const cv::Mat &im, float th, int min_region, int threads,
+                    LabelEngine engine);
+
+/**
+ * @brief Prepare an initialized RegionGrow object for a new image
+ *
+ * @param rg Pointer to a RegionGrow object initialized by `initRegionGrow`
+ * @param im The image to process
+ *
+ * Keeps the threshold, minimum region size, threads, engine, metric,
+ * connectivity and budget, resets
+ * the stats, and reuses
+ * the arena of the previous image: when the new image has the same size,
+ * every buffer is kept and passedBy is reset by starting a new label epoch
+ * instead of being cleared. Otherwise the buffers are carved again, and the
+ * arena is only mapped again if it is too small. SEGS is not cleared,
+ * `colorRegionGrow` rewrites it.
+ */
+void reuseRegionGrow(RegionGrow *rg, const cv::Mat &im);
+
+/**
+ * @brief Free the memory allocated for RegionGrow object
+ *
+ * @param rg Pointer to the RegionGrow object
+ *
+ * Unmaps the arena. SEGS and the passedBy labels are no longer valid
+ * afterwards: clone SEGS first to keep it.
+ */
+void freeRegionGrow(RegionGrow *rg);
+
+/**
+ * @brief Perform a breadth-first search on a RegionGrow object starting from
+ * the given coordinates.
+ *
+ * @param rg Pointer to a RegionGrow object
+ * @param x0 The x-coordinate of the starting point
+ * @param y0 The y-coordinate of the starting point
+ *
+ * This function performs a breadth-first search on a RegionGrow object starting
+ * from the given coordinates. It sets the `regionNum` to the value of the
+ * passedBy label map at the starting point. It then enters a loop until the
+ * frontier is empty. In each iteration, it pops a pixel from the frontier and
+ * increments the `iterations` counter. It then visits the neighbors of the
+ * current coordinate whose distance is below the threshold, as recorded in the
+ * precomputed similarity map. If such a neighbor has not been passed by before,
+ * it sets the passedBy value of the neighbor to `regionNum` and adds it to the
+ * frontier. When small regions are rejected, the neighbor is also recorded in the
+ * journal. The pixels popped, the neighbours visited and the peak frontier
+ * size are added to `stats` once the region is grown. Every pixel popped is
+ * spent from `work`; when it runs out, the frontier is dropped and the region
+ * keeps the pixels labeled so far.
+ */
+void BFS(RegionGrow *rg, int x0, int y0);
+
+/**
+ * @brief Reject the region that has just been grown
+ *
+ * @param rg Pointer to a RegionGrow object
+ *
+ * Rolls back the pixels recorded in the journal for the current region,
+ * labeling them with the reserved `maxLabel()` so that the scan does not seed
+ * them again, and gives the region number back so that region numbers stay
+ * dense.
+ */
+void rejectRegion(RegionGrow *rg);
+
+/**
+ * @brief Label the regions of the image
+ *
+ * @param rg Pointer to a RegionGrow object
+ *
+ * This function labels the image stored in the RegionGrow object into passedBy.
+ * It first computes the similarity map of the image for the threshold, the
+ * metric and the connectivity in a single pass of the kernel specialized for
+ * the image type, vectorized for CV_8UC3 images and the Euclidean metric. It then iterates over each pixel in the image. For
+ * each unprocessed pixel, it sets the currentRegion to the next region number,
+ * sets the passedBy value of the pixel to the currentRegion number, pushes the
+ * pixel to the frontier, and calls the BFS function. Regions with fewer than
+ * `minRegion` pixels are rejected. With more than one thread or with the
+ * scanline engine, the pixels are instead labeled by `growTiled`, which gives
+ * the same labels using parallel tiles. The time of the similarity masks and
+ * of the labeling is added to `stats`, as well as the regions created and
+ * rolled back.
+ *
+ * The serial flood fill spends `budget` from the start of the call: when the
+ * deadline passes or the pixel budget runs out, the region being grown keeps
+ * the pixels it has labeled, and is rejected like any other if it is smaller
+ * than `minRegion`; every pixel not labeled yet is then labeled
+ * `maxLabel()`, like rejected pixels, and `truncated` is set. The budget is
+ * checked once every `WorkBudget::CHECK_EVERY` pixels, so that it costs a
+ * countdown per pixel. The other engines run to completion.
+ *
+ * The pyramid engine labels them with `growPyramid` over `levels` coarser
+ * levels, serially, which gives approximate regions; it computes the
+ * similarity masks of the pixels along the region boundaries only, so that
+ * `similar` is not the full map then. The OpenCL engine labels them with
+ * `growOpenCL` on the default OpenCL device, with the same labels, computing
+ * the similarity map there as well; without a device, or for images other
+ * than CV_8UC3 or metrics other than `METRIC_L2`, it falls back to the
+ * scanline engine.
+ */
+void labelRegionGrow(RegionGrow *rg);
+
+/**
+ * @brief Display color of a label
+ *
+ * @param labels The label map the label comes from
+ * @param label The label
+ *
+ * @return White for unassigned and rejected pixels, `labelColor(label)`
+ * otherwise
+ */
+cv::Vec3b regionColor(const LabelMap &labels, uint32_t label);
+
+/**
+ * @brief Color the segmented image from the labels
+ *
+ * @param rg Pointer to a RegionGrow object
+ *
+ * This function sets the colors of each pixel of SEGS based on its passedBy
+ * value (rejected pixels are white), timed as the colorize phase of `stats`.
+ */
+void colorRegionGrow(RegionGrow *rg);
+
+/**
+ * @brief Apply region growing algorithm to image
+ *
+ * @param rg Pointer to a RegionGrow object
+ *
+ * This function labels the regions of the image with `labelRegionGrow`, then
+ * colors the segmented image with `colorRegionGrow`.
+ */
+void ApplyRegionGrow(RegionGrow *rg);
+
+#endif
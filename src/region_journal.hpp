@@ -0,0 +1,113 @@
+#ifndef REGION_JOURNAL_HPP
+#define REGION_JOURNAL_HPP
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * @brief Journal of the pixels claimed by the region currently growing
+ *
+ * Records the linear index (x * w + y) of every pixel labeled while a region
+ * grows, so that a rejected region can be undone in time proportional to its
+ * own size instead of scanning the whole label image. The buffer is reused
+ * from one region to the next and only grows when a region is larger than
+ * any seen before. It is either owned or attached from the caller's memory,
+ * such as an `Arena`.
+ */
+class RegionJournal
+{
+public:
+  RegionJournal() {}
+
+  RegionJournal(const RegionJournal &) = delete;
+  RegionJournal &operator=(const RegionJournal &) = delete;
+  RegionJournal(RegionJournal &&) = default;
+  RegionJournal &operator=(RegionJournal &&) = default;
+
+  /**
+   * @brief Use the caller's memory as buffer, discarding the current region
+   *
+   * @param buffer Room for capacity pixels, which must outlive its use here
+   * @param capacity Number of pixels of the buffer, h * w for a whole image
+   */
+  void attach(int *buffer, size_t capacity)
+  {
+    std::vector<int>().swap(owned);
+    touched = buffer;
+    cap = capacity;
+    count = 0;
+  }
+
+  /**
+   * @brief Start recording a new region, discarding the previous one
+   */
+  void begin()
+  {
+    count = 0;
+  }
+
+  /**
+   * @brief Record that a pixel has been claimed by the current region
+   *
+   * @param idx Linear index of the pixel
+   */
+  void record(int idx)
+  {
+    if (count == cap)
+      grow();
+    touched[count++] = idx;
+  }
+
+  /**
+   * @brief Number of pixels claimed by the current region
+   */
+  size_t size() const
+  {
+    return count;
+  }
+
+  /**
+   * @brief Linear indices of the `size()` pixels claimed by the current region, in claim order
+   */
+  const int *pixels() const
+  {
+    return touched;
+  }
+
+  /**
+   * @brief Undo the current region
+   *
+   * @param labels Pointer to the first element of a continuous label image
+   * @param fill Value written back to every claimed pixel
+   *
+   * Writes `fill` to every recorded pixel and clears the journal.
+   */
+  template <typename Label>
+  void rollback(Label *labels, Label fill = 0)
+  {
+    for (size_t i = 0; i < count; i++)
+      labels[touched[i]] = fill;
+    count = 0;
+  }
+
+private:
+  /**
+   * @brief Double the buffer, keeping the recorded pixels
+   */
+  void grow()
+  {
+    std::vector<int> larger(cap == 0 ? 1024 : 2 * cap);
+    std::copy(touched, touched + count, larger.begin());
+    owned.swap(larger);
+    touched = owned.data();
+    cap = owned.size();
+  }
+
+  std::vector<int> owned; // buffer, unless attached
+  int *touched = NULL;
+  size_t cap = 0;
+  size_t count = 0; // number of recorded pixels
+};
+
+#endif
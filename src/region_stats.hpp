@@ -0,0 +1,187 @@
+#ifndef REGION_STATS_HPP
+#define REGION_STATS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <vector>
+
+/**
+ * @brief Running color moments of a set of pixels
+ *
+ * Pixel count, per-channel mean color and per-channel sum of squared
+ * deviations from the mean, updated in O(1) per pixel with Welford's online
+ * algorithm.
+ */
+struct ColorMoments
+{
+  size_t count = 0;
+  cv::Vec3d mean;
+  cv::Vec3d m2; // sums of squared deviations from the mean
+
+  /**
+   * @brief Add the color of a pixel
+   */
+  void add(const cv::Vec3d &color)
+  {
+    count++;
+    for (int c = 0; c < 3; c++)
+    {
+      double delta = color[c] - mean[c];
+      mean[c] += delta / count;
+      m2[c] += delta * (color[c] - mean[c]);
+    }
+  }
+
+  /**
+   * @brief Per-channel (population) variance, or zeros if there is no pixel
+   */
+  cv::Vec3d variance() const
+  {
+    if (count == 0)
+      return cv::Vec3d();
+    return m2 * (1.0 / count);
+  }
+
+  /**
+   * @brief Standard deviation of the colors, as a color distance
+   *
+   * @return The square root of the summed channel variances, that is the root
+   * mean square distance of the colors to their mean color
+   */
+  double stddev() const
+  {
+    cv::Vec3d v = variance();
+    return std::sqrt(v[0] + v[1] + v[2]);
+  }
+};
+
+/**
+ * @brief Running statistics of a labeling in progress
+ *
+ * Keeps the number of assigned pixels, and the color moments of every region.
+ * Every label write goes through `add()`, so completion checks, region sizes,
+ * means and variances are O(1) reads instead of scans over the label image.
+ */
+class RegionStats
+{
+public:
+  /**
+   * @brief Reset the statistics for a new labeling
+   *
+   * @param total_pixels Number of pixels in the image being labeled
+   */
+  void reset(size_t total_pixels)
+  {
+    total = total_pixels;
+    assigned = 0;
+    regions.assign(1, ColorMoments());
+  }
+
+  /**
+   * @brief Record that a pixel has been assigned to a region
+   *
+   * @param region The region number (> 0) the pixel was assigned to
+   * @param color The color of the pixel
+   */
+  void add(int region, const cv::Vec3d &color)
+  {
+    if (region >= (int)regions.size())
+      regions.resize(region + 1);
+    regions[region].add(color);
+    assigned++;
+  }
+
+  /**
+   * @brief Record a whole region whose moments were accumulated elsewhere
+   *
+   * @param region The region number (> 0), which must be empty
+   * @param moments The moments of the pixels of the region
+   */
+  void assign(int region, const ColorMoments &moments)
+  {
+    if (region >= (int)regions.size())
+      regions.resize(region + 1);
+    assigned += moments.count - regions[region].count;
+    regions[region] = moments;
+  }
+
+  /**
+   * @brief Forget every pixel of a region
+   *
+   * @param region The region number to drop
+   *
+   * Used when a region is rolled back; the caller is responsible for
+   * clearing the labels themselves.
+   */
+  void dropRegion(int region)
+  {
+    if (region <= 0 || region >= (int)regions.size())
+      return;
+    assigned -= regions[region].count;
+    regions[region] = ColorMoments();
+  }
+
+  /**
+   * @brief Color moments of a region, all zeros if the region is empty
+   */
+  const ColorMoments &moments(int region) const
+  {
+    static const ColorMoments none;
+    return region > 0 && region < (int)regions.size() ? regions[region] : none;
+  }
+
+  /**
+   * @brief Number of pixels assigned to a region
+   */
+  size_t count(int region) const
+  {
+    return moments(region).count;
+  }
+
+  /**
+   * @brief Mean color of a region, or zeros if the region is empty
+   */
+  cv::Vec3d mean(int region) const
+  {
+    return moments(region).mean;
+  }
+
+  /**
+   * @brief Per-channel (population) variance of the colors of a region, or zeros if the region is empty
+   */
+  cv::Vec3d variance(int region) const
+  {
+    return moments(region).variance();
+  }
+
+  /**
+   * @brief Standard deviation of the colors of a region, see `ColorMoments::stddev()`
+   */
+  double stddev(int region) const
+  {
+    return moments(region).stddev();
+  }
+
+  /**
+   * @brief Number of pixels assigned to any region
+   */
+  size_t assignedPixels() const
+  {
+    return assigned;
+  }
+
+  /**
+   * @brief Whether every pixel of the image has been assigned
+   */
+  bool complete() const
+  {
+    return assigned == total;
+  }
+
+private:
+  size_t total = 0;
+  size_t assigned = 0;
+  std::vector<ColorMoments> regions; // indexed by region number, 0 is unused
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef RUN_STATS_HPP
+#define RUN_STATS_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+// Compile with -DREGGROW_NO_STATS (make STATS=0) to remove every counter
+// update and timer from the hot paths; the reports then hold zeros.
+#ifdef REGGROW_NO_STATS
+#define REGGROW_STAT(expr) ((void)sizeof(expr)) // not evaluated
+#else
+#define REGGROW_STAT(expr) ((void)(expr))
+#endif
+
+// phases of a run, timed by PhaseTimer
+enum Phase
+{
+  PHASE_LOAD,       // reading and decoding the image
+  PHASE_CONVERT,    // conversion to the color space of the distances
+  PHASE_SIMILARITY, // similarity masks
+  PHASE_LABEL,      // labeling or growing the regions
+  PHASE_MERGE,      // region adjacency graph and merging of small regions
+  PHASE_COLORIZE,   // coloring the segmented image
+  PHASE_SAVE,       // encoding and writing the result
+  PHASE_COUNT
+};
+
+/**
+ * @brief Write a string as a quoted JSON string
+ */
+inline void writeJsonString(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (const char *c = s; *c; c++)
+  {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', f);
+    if ((unsigned char)*c < 0x20)
+      fprintf(f, "\\u%04x", *c);
+    else
+      fputc(*c, f);
+  }
+  fputc('"', f);
+}
+
+/**
+ * @brief Counters of the inner loop of region growing
+ *
+ * Kept in a local object by the growing loops and added to the `RunStats` of
+ * the run once per region or per thread, so that the hot path only updates
+ * registers.
+ */
+struct GrowCounters
+{
+  uint64_t popped = 0;       // pixels taken from a frontier or queue
+  uint64_t accepted = 0;     // neighbours tested that joined a region
+  uint64_t rejected = 0;     // neighbours tested that did not
+  uint64_t peakFrontier = 0; // most pixels waiting at once
+
+  void pop()
+  {
+    REGGROW_STAT(popped++);
+  }
+
+  /**
+   * @brief Count the test of a neighbour and pass its result through
+   */
+  bool test(bool accept)
+  {
+    REGGROW_STAT(accept ? accepted++ : rejected++);
+    return accept;
+  }
+
+  void frontier(size_t size)
+  {
+    REGGROW_STAT(peakFrontier = std::max<uint64_t>(peakFrontier, size));
+  }
+
+  /**
+   * @brief Add the counts of another loop; the peak is the larger of both
+   */
+  void add(const GrowCounters &other)
+  {
+    REGGROW_STAT(popped += other.popped);
+    REGGROW_STAT(accepted += other.accepted);
+    REGGROW_STAT(rejected += other.rejected);
+    REGGROW_STAT(peakFrontier = std::max(peakFrontier, other.peakFrontier));
+  }
+};
+
+/**
+ * @brief Counters and phase times of the segmentation of one image
+ *
+ * Only the loops that visit pixels one by one (the serial flood fill and the
+ * seeded growth) fill the growth counters; the other engines report their
+ * regions and phase times.
+ */
+struct RunStats
+{
+  GrowCounters grow;
+  uint64_t created = 0;    // regions started
+  uint64_t rolledBack = 0; // regions given back for being too small
+  bool capHit = false;     // growth stopped at the iteration cap or budget
+  uint64_t unvisited = 0;  // pixels the serial flood fill left unvisited when it did
+  double ms[PHASE_COUNT] = {};
+
+  void reset()
+  {
+    *this = RunStats();
+  }
+
+  /**
+   * @brief Add the counts and times of another run, such as its I/O phases
+   */
+  void add(const RunStats &other)
+  {
+    grow.add(other.grow);
+    created += other.created;
+    rolledBack += other.rolledBack;
+    capHit = capHit || other.capHit;
+    unvisited += other.unvisited;
+    for (int p = 0; p < PHASE_COUNT; p++)
+      ms[p] += other.ms[p];
+  }
+
+  /**
+   * @brief Time of all the phases, in milliseconds
+   */
+  double totalMs() const
+  {
+    double total = 0;
+    for (int p = 0; p < PHASE_COUNT; p++)
+      total += ms[p];
+    return total;
+  }
+
+  /**
+   * @brief Write the stats as one JSON object on a line
+   *
+   * @param f The file, such as stdout
+   * @param image Name of the image
+   * @param w Width of the image
+   * @param h Height of the image
+   * @param regions Number of regions
+   *
+   * @return False on a write error
+   */
+  bool write(FILE *f, const char *image, int w, int h, int regions) const
+  {
+    static const char *const names[PHASE_COUNT] = {"load", "convert", "similarity", "label", "merge", "colorize", "save"};
+    fputs("{\"image\": ", f);
+    writeJsonString(f, image);
+    fprintf(f,
+            ", \"width\": %d, \"height\": %d, \"regions\": %d, \"popped\": %llu, \"tests\": %llu, "
+            "\"accepted\": %llu, \"rejected\": %llu, \"peak_frontier\": %llu, \"created\": %llu, "
+            "\"rolled_back\": %llu, \"cap_hit\": %s, \"unvisited\": %llu",
+            w, h, regions, (unsigned long long)grow.popped, (unsigned long long)(grow.accepted + grow.rejected),
+            (unsigned long long)grow.accepted, (unsigned long long)grow.rejected,
+            (unsigned long long)grow.peakFrontier, (unsigned long long)created, (unsigned long long)rolledBack,
+            capHit ? "true" : "false", (unsigned long long)unvisited);
+    for (int p = 0; p < PHASE_COUNT; p++)
+      fprintf(f, ", \"%s_ms\": %.3f", names[p], ms[p]);
+    fputs("}\n", f);
+    return fflush(f) == 0 && !ferror(f);
+  }
+};
+
+/**
+ * @brief Add the time of a scope to a phase of a run
+ */
+class PhaseTimer
+{
+public:
+#ifdef REGGROW_NO_STATS
+  PhaseTimer(RunStats &, Phase) {}
+#else
+  PhaseTimer(RunStats &stats, Phase phase) : stats(stats), phase(phase), start(std::chrono::steady_clock::now()) {}
+
+  ~PhaseTimer()
+  {
+    stats.ms[phase] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  RunStats &stats;
+  Phase phase;
+  std::chrono::steady_clock::time_point start;
+#endif
+
+public:
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+#endif
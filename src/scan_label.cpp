@@ -0,0 +1,58 @@
+#include "scan_label.hpp"
+#include "union_find.hpp"
+
+void scanLabelRows(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels,
+                   int r0, int r1, std::vector<size_t> &sizes)
+{
+  const int w = similar.mat().cols;
+  const unsigned scanned = nbh.mask() & 0x0Fu; // slots 0 to 3: row above and left
+  UnionFind sets;
+  std::vector<size_t> count(1, 0);
+
+  for (int x = r0; x < r1; x++)
+  {
+    unsigned rowMask = x == r0 ? scanned & ~0x07u : scanned;
+    for (int y = 0; y < w; y++)
+    {
+      int idx = x * w + y;
+      uint32_t label = 0;
+      // edges are not transitive, so every similar scanned neighbour has to
+      // be united with the pixel, not only the first one
+      nbh.forEachIn(x, y, similar.bits(idx) & rowMask, [&](int, int, int nidx)
+      {
+        uint32_t l = labels.get(nidx);
+        if (label == 0)
+          label = l;
+        else
+          sets.unite(label, l);
+        return true;
+      });
+      if (label == 0)
+      {
+        label = sets.add();
+        count.push_back(0);
+      }
+      labels.set(idx, label);
+      count[label]++;
+    }
+  }
+
+  const uint32_t n = sets.size();
+  std::vector<uint32_t> region(n + 1, 0);
+  sizes.clear();
+  for (uint32_t id = 1; id <= n; id++)
+  {
+    uint32_t root = sets.find(id);
+    if (root == id)
+    {
+      sizes.push_back(0);
+      region[id] = (uint32_t)sizes.size();
+    }
+    else
+      region[id] = region[root];
+    sizes[region[id] - 1] += count[id];
+  }
+
+  for (int idx = r0 * w; idx < r1 * w; idx++)
+    labels.set(idx, region[labels.get(idx)]);
+}
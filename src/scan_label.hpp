@@ -0,0 +1,43 @@
+#ifndef SCAN_LABEL_HPP
+#define SCAN_LABEL_HPP
+
+#include <vector>
+#include "label_map.hpp"
+#include "neighbourhood.hpp"
+#include "similarity_map.hpp"
+
+/**
+ * @brief Algorithms available to label the regions of an image
+ */
+enum LabelEngine
+{
+  ENGINE_FLOOD,   // stack-driven flood fill from each unlabeled pixel
+  ENGINE_SCAN,    // two-pass scanline union-find
+  ENGINE_PYRAMID, // coarse to fine over an image pyramid, regrowing only the region boundaries
+  ENGINE_OPENCL   // label propagation on an OpenCL device, the scanline engine without one
+};
+
+/**
+ * @brief Label the regions of the rows [r0, r1) with a two-pass union-find
+ *
+ * @param similar Similarity map of the image for the threshold
+ * @param nbh Neighbourhood of the image
+ * @param labels Label map of the image, zero on the rows, sized for h * w regions
+ * @param r0 First row
+ * @param r1 Row after the last one
+ * @param sizes Receives the number of pixels of each region, in label order
+ *
+ * The first pass scans the rows in raster order and gives each pixel the
+ * label of its already scanned similar neighbours (left and row above),
+ * recording the equivalence of their labels, or a new provisional label if
+ * there is none. The second pass replaces provisional labels by region
+ * labels. Neighbours outside the rows are ignored.
+ *
+ * Memory is accessed sequentially and no frontier is kept. The regions, and
+ * their labels 1..n in raster order of their first pixel, are the same as
+ * with a flood fill of the rows.
+ */
+void scanLabelRows(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels,
+                   int r0, int r1, std::vector<size_t> &sizes);
+
+#endif
@@ -0,0 +1,149 @@
+#include "seeds.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+/**
+ * @brief Parse an `x,y` CSV line
+ *
+ * @return Whether the line is exactly two integers separated by a comma
+ */
+static bool parsePair(const std::string &line, int &x, int &y)
+{
+  char trailing;
+  return sscanf(line.c_str(), " %d , %d %c", &x, &y, &trailing) == 2;
+}
+
+/**
+ * @brief Read a CSV file of `x,y` lines, see `readSeeds()`
+ */
+static bool readCsvSeeds(std::ifstream &in, std::vector<Seed> &seeds)
+{
+  std::string line;
+  bool first = true;
+  while (std::getline(in, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+
+    int x, y;
+    if (parsePair(line, x, y))
+      seeds.push_back(Seed(y, x));
+    else if (!first) // only the first line may be a header
+      return false;
+    first = false;
+  }
+  return true;
+}
+
+/**
+ * @brief Cursor over JSON text, skipping whitespace
+ */
+struct JsonCursor
+{
+  const char *p;
+
+  bool accept(char c)
+  {
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p != c)
+      return false;
+    p++;
+    return true;
+  }
+
+  bool integer(int &value)
+  {
+    while (isspace((unsigned char)*p))
+      p++;
+    char *end;
+    long v = strtol(p, &end, 10);
+    if (end == p || *end == '.' || *end == 'e' || *end == 'E')
+      return false;
+    p = end;
+    value = (int)v;
+    return true;
+  }
+};
+
+/**
+ * @brief Read a JSON array of [x, y] pairs, see `readSeeds()`
+ */
+static bool readJsonSeeds(std::ifstream &in, std::vector<Seed> &seeds)
+{
+  std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  JsonCursor c{text.c_str()};
+  if (!c.accept('['))
+    return false;
+  if (c.accept(']'))
+    return c.accept('\0');
+  do
+  {
+    int x, y;
+    if (!c.accept('[') || !c.integer(x) || !c.accept(',') || !c.integer(y) || !c.accept(']'))
+      return false;
+    seeds.push_back(Seed(y, x));
+  } while (c.accept(','));
+  return c.accept(']') && c.accept('\0');
+}
+
+bool readSeeds(const std::string &path, std::vector<Seed> &seeds)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string ext = path.size() >= 5 ? path.substr(path.size() - 5) : "";
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return (char)std::tolower(ch); });
+  return ext == ".json" ? readJsonSeeds(in, seeds) : readCsvSeeds(in, seeds);
+}
+
+std::vector<Seed> gridSeeds(int h, int w, int step)
+{
+  std::vector<Seed> seeds;
+  seeds.reserve((size_t)((h + step - 1) / step) * ((w + step - 1) / step));
+  for (int x = 0; x < h; x += step)
+  {
+    for (int y = 0; y < w; y += step)
+      seeds.push_back(Seed(std::min(x + step / 2, h - 1), std::min(y + step / 2, w - 1)));
+  }
+  return seeds;
+}
+
+std::vector<Seed> minimaSeeds(const cv::Mat &im, int step)
+{
+  cv::Mat gray, gradient;
+  cv::cvtColor(im, gray, cv::COLOR_BGR2GRAY);
+  cv::morphologyEx(gray, gradient, cv::MORPH_GRADIENT, cv::Mat::ones(3, 3, CV_8U));
+
+  std::vector<Seed> seeds;
+  for (int x = 0; x < im.rows; x += step)
+  {
+    for (int y = 0; y < im.cols; y += step)
+    {
+      cv::Rect cell(y, x, std::min(step, im.cols - y), std::min(step, im.rows - x));
+      cv::Point flattest;
+      cv::minMaxLoc(gradient(cell), NULL, NULL, &flattest, NULL);
+      Seed seed(x + flattest.y, y + flattest.x);
+      if (im.at<cv::Vec3b>(seed.first, seed.second) != cv::Vec3b(0, 0, 0))
+        seeds.push_back(seed);
+    }
+  }
+  return seeds;
+}
+
+size_t clipSeeds(std::vector<Seed> &seeds, int h, int w)
+{
+  size_t before = seeds.size();
+  seeds.erase(std::remove_if(seeds.begin(), seeds.end(), [&](const Seed &s)
+  {
+    return s.first < 0 || s.first >= h || s.second < 0 || s.second >= w;
+  }), seeds.end());
+  return before - seeds.size();
+}
@@ -0,0 +1,68 @@
+#ifndef SEEDS_HPP
+#define SEEDS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+// a seed pixel, as (row, column)
+typedef std::pair<int, int> Seed;
+
+/**
+ * @brief Read seeds from a CSV or JSON file
+ *
+ * @param path Path of the file. A `.json` file holds an array of [x, y]
+ * pairs, such as `[[12, 40], [200, 31]]`. Any other file is read as CSV, one
+ * `x,y` pair per line; empty lines, lines starting with `#` and a header
+ * line are skipped.
+ * @param seeds Receives the seeds, appended in file order
+ *
+ * x is the column and y the row of the pixel, as in the image window, so the
+ * seeds are stored as (y, x).
+ *
+ * @return False if the file cannot be read or a line or value is not a pair
+ * of integers
+ */
+bool readSeeds(const std::string &path, std::vector<Seed> &seeds);
+
+/**
+ * @brief Seeds on a regular grid
+ *
+ * @param h Height of the image
+ * @param w Width of the image
+ * @param step Spacing of the grid in pixels, > 0
+ *
+ * @return The center of every step x step cell of the image, row by row
+ */
+std::vector<Seed> gridSeeds(int h, int w, int step);
+
+/**
+ * @brief Seeds at the local minima of the color gradient
+ *
+ * @param im The CV_8UC3 image
+ * @param step Side of the cells in pixels, > 0
+ *
+ * @return One seed per step x step cell of the image, row by row: the pixel
+ * with the lowest gradient magnitude of the cell, that is the flattest spot,
+ * away from edges. Cells whose flattest pixel is black are skipped, since
+ * black pixels never start a region.
+ *
+ * The gradient is the morphological gradient (3 x 3 dilation minus erosion)
+ * of the grayscale image and each cell minimum is found with `cv::minMaxLoc`,
+ * all vectorized passes over the image.
+ */
+std::vector<Seed> minimaSeeds(const cv::Mat &im, int step);
+
+/**
+ * @brief Remove the seeds outside an image
+ *
+ * @param seeds The seeds to filter, kept in order
+ * @param h Height of the image
+ * @param w Width of the image
+ *
+ * @return The number of seeds removed
+ */
+size_t clipSeeds(std::vector<Seed> &seeds, int h, int w);
+
+#endif
@@ -0,0 +1,297 @@
+#include "similarity_map.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include "color_distance.hpp"
+
+// row and column offsets of the neighbour in slot k
+static const int SLOT_OFFSETS[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+
+/**
+ * @brief Mark the similar pixel pairs of two runs of pixels
+ *
+ * @param a First run of n BGR pixels
+ * @param b Second run of n BGR pixels, a[i] is compared to b[i]
+ * @param n Number of pixels
+ * @param thresh2 Squared distance bound
+ * @param ma Masks of the pixels of a, bit_a is set on similar pairs
+ * @param mb Masks of the pixels of b, bit_b is set on similar pairs
+ *
+ * ma and mb may overlap: each block of pixels updates ma before mb.
+ */
+static void markSimilar(const uchar *a, const uchar *b, int n, int thresh2,
+                        uchar *ma, uchar *mb, uchar bit_a, uchar bit_b)
+{
+  int i = 0;
+#if CV_SIMD128
+  // squared distances are summed with unsigned 16-bit saturation, which is
+  // exact as long as the bound itself fits in 16 bits
+  if (thresh2 <= 0xFFFF)
+  {
+    const cv::v_uint16x8 vt2 = cv::v_setall_u16((ushort)thresh2);
+    const cv::v_uint8x16 vbit_a = cv::v_setall_u8(bit_a), vbit_b = cv::v_setall_u8(bit_b);
+    for (; i <= n - 16; i += 16)
+    {
+      cv::v_uint8x16 a0, a1, a2, b0, b1, b2;
+      cv::v_load_deinterleave(a + 3 * i, a0, a1, a2);
+      cv::v_load_deinterleave(b + 3 * i, b0, b1, b2);
+      cv::v_uint8x16 d0 = cv::v_absdiff(a0, b0);
+      cv::v_uint8x16 d1 = cv::v_absdiff(a1, b1);
+      cv::v_uint8x16 d2 = cv::v_absdiff(a2, b2);
+
+      cv::v_uint16x8 s0_lo, s0_hi, s1_lo, s1_hi, s2_lo, s2_hi;
+      cv::v_mul_expand(d0, d0, s0_lo, s0_hi);
+      cv::v_mul_expand(d1, d1, s1_lo, s1_hi);
+      cv::v_mul_expand(d2, d2, s2_lo, s2_hi);
+      cv::v_uint16x8 lo = s0_lo + s1_lo + s2_lo; // saturating
+      cv::v_uint16x8 hi = s0_hi + s1_hi + s2_hi;
+      cv::v_uint8x16 similar = cv::v_pack(lo < vt2, hi < vt2); // 0xFF where similar
+
+      cv::v_store(ma + i, cv::v_load(ma + i) | (similar & vbit_a));
+      cv::v_store(mb + i, cv::v_load(mb + i) | (similar & vbit_b));
+    }
+  }
+#endif
+  for (; i < n; i++)
+  {
+    if (distance2(*(const cv::Vec3b *)(a + 3 * i), *(const cv::Vec3b *)(b + 3 * i)) < thresh2)
+    {
+      ma[i] |= bit_a;
+      mb[i] |= bit_b;
+    }
+  }
+}
+
+/**
+ * @brief Marker of the similar pixel pairs of two runs, for a pixel type and a metric
+ *
+ * The arguments are those of `markSimilar()`, with runs of CN channels of
+ * type T and a bound of `distanceBound<T>()`.
+ */
+template <typename T, int CN, ColorMetric M>
+struct RunMarker
+{
+  typedef typename DistanceType<T>::type D;
+
+  static void mark(const T *a, const T *b, int n, D bound, uchar *ma, uchar *mb, uchar bit_a, uchar bit_b)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      if (pixelDistance<M, CN>(a + CN * i, b + CN * i) < bound)
+      {
+        ma[i] |= bit_a;
+        mb[i] |= bit_b;
+      }
+    }
+  }
+};
+
+template <>
+struct RunMarker<uchar, 3, METRIC_L2>
+{
+  static void mark(const uchar *a, const uchar *b, int n, int bound, uchar *ma, uchar *mb, uchar bit_a, uchar bit_b)
+  {
+    markSimilar(a, b, n, bound, ma, mb, bit_a, bit_b);
+  }
+};
+
+/**
+ * @brief Compute the similarity masks of an image with a specialized kernel
+ *
+ * @param im Image of CN channels of type T
+ * @param bound Bound of `pixelDistance()`, see `distanceBound()`
+ * @param masks The CV_8U masks, all zeros
+ *
+ * Every pixel pair is compared once: each pixel is compared to its right,
+ * bottom-left, bottom and bottom-right neighbours (slots 4 to 7), or only to
+ * its right and bottom ones with 4-connectivity, and the result is also
+ * written to the opposite slot of the neighbour.
+ */
+template <typename T, int CN, ColorMetric M, int CONNECTIVITY>
+static void computeMasks(const cv::Mat &im, typename DistanceType<T>::type bound, cv::Mat &masks)
+{
+  static const int forward[4][3] = {{4, 0, 1}, {6, 1, 0}, {5, 1, -1}, {7, 1, 1}}; // slot, dx, dy; diagonals last
+  const int directions = CONNECTIVITY == 8 ? 4 : 2;
+  const int h = im.rows, w = im.cols;
+  for (int x = 0; x < h; x++)
+  {
+    for (int d = 0; d < directions; d++)
+    {
+      int slot = forward[d][0], dx = forward[d][1], dy = forward[d][2];
+      if (x + dx >= h)
+        continue;
+      int y0 = dy < 0 ? 1 : 0;      // first column with a neighbour in this slot
+      int n = w - (dy != 0 ? 1 : 0); // number of such columns
+      RunMarker<T, CN, M>::mark(im.ptr<T>(x) + CN * y0, im.ptr<T>(x + dx) + CN * (y0 + dy), n, bound,
+                                masks.ptr<uchar>(x) + y0, masks.ptr<uchar>(x + dx) + y0 + dy,
+                                (uchar)(1 << slot), (uchar)(1 << (7 - slot)));
+    }
+  }
+}
+
+/**
+ * @brief Compute the similarity masks of some pixels of an image with a specialized kernel
+ *
+ * @param im Image of CN channels of type T
+ * @param bound Bound of `pixelDistance()`, see `distanceBound()`
+ * @param pixels Linear indices of the pixels
+ * @param n Number of pixels
+ * @param masks The CV_8U masks; only those of the pixels are written
+ *
+ * Every pixel is compared to each of its neighbours in turn, so a pair of
+ * listed pixels is compared twice; this pays off when the pixels are few.
+ */
+template <typename T, int CN, ColorMetric M, int CONNECTIVITY>
+static void computePixelMasks(const cv::Mat &im, typename DistanceType<T>::type bound, const uint32_t *pixels, size_t n,
+                              cv::Mat &masks)
+{
+  const unsigned slots = CONNECTIVITY == 8 ? 0xFFu : 0x5Au; // slots 1, 3, 4 and 6 with 4-connectivity
+  const int h = im.rows, w = im.cols;
+  for (size_t i = 0; i < n; i++)
+  {
+    int x = (int)(pixels[i] / (uint32_t)w), y = (int)(pixels[i] % (uint32_t)w);
+    const T *p = im.ptr<T>(x) + CN * y;
+    uchar bits = 0;
+    for (int k = 0; k < 8; k++)
+    {
+      int nx = x + SLOT_OFFSETS[k][0], ny = y + SLOT_OFFSETS[k][1];
+      if ((slots & (1u << k)) && nx >= 0 && nx < h && ny >= 0 && ny < w &&
+          pixelDistance<M, CN>(p, im.ptr<T>(nx) + CN * ny) < bound)
+        bits |= (uchar)(1u << k);
+    }
+    masks.data[pixels[i]] = bits;
+  }
+}
+
+// kernels of the similarity masks of one image type, metric and connectivity:
+// of the whole image, and of a list of its pixels
+struct MaskKernel
+{
+  void (*all)(const cv::Mat &im, double thresh, cv::Mat &masks);
+  void (*some)(const cv::Mat &im, double thresh, const uint32_t *pixels, size_t n, cv::Mat &masks);
+
+  explicit operator bool() const
+  {
+    return all != NULL;
+  }
+};
+
+template <typename T, int CN, ColorMetric M, int CONNECTIVITY>
+static void maskKernel(const cv::Mat &im, double thresh, cv::Mat &masks)
+{
+  computeMasks<T, CN, M, CONNECTIVITY>(im, distanceBound<T>(M, thresh), masks);
+}
+
+template <typename T, int CN, ColorMetric M, int CONNECTIVITY>
+static void pixelMaskKernel(const cv::Mat &im, double thresh, const uint32_t *pixels, size_t n, cv::Mat &masks)
+{
+  computePixelMasks<T, CN, M, CONNECTIVITY>(im, distanceBound<T>(M, thresh), pixels, n, masks);
+}
+
+template <typename T, int CN, ColorMetric M>
+static MaskKernel pickKernel(int connectivity)
+{
+  if (connectivity == 4)
+    return MaskKernel{maskKernel<T, CN, M, 4>, pixelMaskKernel<T, CN, M, 4>};
+  return MaskKernel{maskKernel<T, CN, M, 8>, pixelMaskKernel<T, CN, M, 8>};
+}
+
+template <typename T, int CN>
+static MaskKernel pickKernel(ColorMetric metric, int connectivity)
+{
+  switch (metric)
+  {
+  case METRIC_L1:
+    return pickKernel<T, CN, METRIC_L1>(connectivity);
+  case METRIC_CHEBYSHEV:
+    return pickKernel<T, CN, METRIC_CHEBYSHEV>(connectivity);
+  default:
+    return pickKernel<T, CN, METRIC_L2>(connectivity);
+  }
+}
+
+template <typename T>
+static MaskKernel pickKernel(int channels, ColorMetric metric, int connectivity)
+{
+  switch (channels)
+  {
+  case 1:
+    return pickKernel<T, 1>(metric, connectivity);
+  case 3:
+    return pickKernel<T, 3>(metric, connectivity);
+  case 4:
+    return pickKernel<T, 4>(metric, connectivity);
+  default:
+    return MaskKernel{};
+  }
+}
+
+/**
+ * @brief Kernels instantiated for an image type, or null ones if there are none
+ */
+static MaskKernel pickKernel(int type, ColorMetric metric, int connectivity)
+{
+  switch (CV_MAT_DEPTH(type))
+  {
+  case CV_8U:
+    return pickKernel<uchar>(CV_MAT_CN(type), metric, connectivity);
+  case CV_16U:
+    return pickKernel<ushort>(CV_MAT_CN(type), metric, connectivity);
+  case CV_32F:
+    return pickKernel<float>(CV_MAT_CN(type), metric, connectivity);
+  default:
+    return MaskKernel{};
+  }
+}
+
+void SimilarityMap::compute(const cv::Mat &im, int thresh2)
+{
+  CV_Assert(im.type() == CV_8UC3);
+  masks.create(im.rows, im.cols, CV_8U); // reuses the masks of the previous image of the same size
+  masks.setTo(0);
+  computeMasks<uchar, 3, METRIC_L2, 8>(im, thresh2, masks);
+}
+
+void SimilarityMap::compute(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity)
+{
+  MaskKernel kernel = pickKernel(im.type(), metric, connectivity);
+  if (!kernel)
+    CV_Error(cv::Error::StsUnsupportedFormat, "similarity masks need 1, 3 or 4 channels of 8U, 16U or 32F");
+  masks.create(im.rows, im.cols, CV_8U);
+  masks.setTo(0);
+  kernel.all(im, thresh, masks);
+}
+
+void SimilarityMap::computeAt(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity,
+                              const std::vector<uint32_t> &pixels)
+{
+  MaskKernel kernel = pickKernel(im.type(), metric, connectivity);
+  if (!kernel)
+    CV_Error(cv::Error::StsUnsupportedFormat, "similarity masks need 1, 3 or 4 channels of 8U, 16U or 32F");
+  masks.create(im.rows, im.cols, CV_8U);
+  kernel.some(im, thresh, pixels.data(), pixels.size(), masks);
+}
+
+bool SimilarityMap::supports(int type)
+{
+  return (bool)pickKernel(type, METRIC_L2, 8);
+}
+
+void SimilarityMap::update(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity,
+                            const std::vector<uint32_t> &pixels)
+{
+  computeAt(im, thresh, metric, connectivity, pixels);
+  const int h = masks.rows, w = masks.cols;
+  for (uint32_t idx : pixels)
+  {
+    int x = (int)(idx / w), y = (int)(idx % w);
+    uchar m = masks.data[idx];
+    for (int k = 0; k < 8; k++)
+    {
+      int nx = x + SLOT_OFFSETS[k][0], ny = y + SLOT_OFFSETS[k][1];
+      if (nx < 0 || nx >= h || ny < 0 || ny >= w)
+        continue;
+      uchar &nm = masks.data[nx * w + ny];
+      uchar opposite = (uchar)(1 << (7 - k));
+      nm = (m >> k) & 1 ? nm | opposite : nm & (uchar)~opposite;
+    }
+  }
+}
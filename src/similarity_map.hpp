@@ -0,0 +1,136 @@
+#ifndef SIMILARITY_MAP_HPP
+#define SIMILARITY_MAP_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <vector>
+#include "color_distance.hpp"
+
+/**
+ * @brief Per-pixel mask of the neighbours similar to each pixel
+ *
+ * For a 3-channel 8-bit image and a squared threshold t2, bit k of the
+ * mask of a pixel is set when its neighbour in slot k (see `Neighbourhood`)
+ * exists and is at a squared distance < t2. The whole map is computed in one
+ * vectorized pass over the image, so that region growing only consults bits
+ * instead of fetching and comparing colors for every neighbour test.
+ *
+ * Images of 1, 3 or 4 channels of 8-bit, 16-bit or float pixels, other
+ * metrics and 4-connectivity are computed by kernels specialized at compile
+ * time for each combination, see `compute(const cv::Mat &, double, ColorMetric, int)`.
+ * Every engine then grows regions from the bits alone, whatever the image type.
+ */
+class SimilarityMap
+{
+public:
+  /**
+   * @brief Compute the similarity masks of an image
+   *
+   * @param im CV_8UC3 image
+   * @param thresh2 Squared distance bound, see `squaredThreshold()`
+   */
+  void compute(const cv::Mat &im, int thresh2);
+
+  /**
+   * @brief Compute the similarity masks of an image of any supported type
+   *
+   * @param im Image of 1, 3 or 4 channels of CV_8U, CV_16U or CV_32F, see `supports()`
+   * @param thresh Distance threshold: neighbours closer than this are similar
+   * @param metric Distance between two pixels
+   * @param connectivity 4 to only compare the neighbours of slots 1, 3, 4 and 6, or 8
+   *
+   * Picks the kernel instantiated for the depth, the channel count, the metric
+   * and the connectivity, in which the channel loop is unrolled and the
+   * metric has no branch; a CV_8UC3 image with `METRIC_L2` uses the
+   * vectorized pass of `compute(const cv::Mat &, int)`. With 4-connectivity
+   * the diagonal pairs are not compared and their bits stay clear. Throws
+   * `cv::Exception` for other image types.
+   */
+  void compute(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity = 8);
+
+  /**
+   * @brief Compute the similarity masks of some pixels of an image only
+   *
+   * @param im Image of a type `supports()`
+   * @param thresh Distance threshold, as for `compute()`
+   * @param metric Distance between two pixels
+   * @param connectivity 4 or 8, as for `compute()`
+   * @param pixels Linear indices (x * w + y) of the pixels
+   *
+   * The masks of the pixels are those `compute()` gives, and the masks of
+   * the other pixels are left as they were, undefined in a map just sized
+   * for the image. Each pixel is compared to all its neighbours, so this is
+   * cheaper than `compute()` only for a small part of the image, such as the
+   * region boundaries `growPyramid` grows again.
+   */
+  void computeAt(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity,
+                 const std::vector<uint32_t> &pixels);
+
+  /**
+   * @brief Whether `compute()` has a kernel for images of a type
+   */
+  static bool supports(int type);
+
+  /**
+   * @brief Keep the masks of h x w images in the caller's memory
+   *
+   * @param buffer Room for h * w masks, which must outlive the map
+   * @param h Height of the images
+   * @param w Width of the images
+   *
+   * `compute()` then writes to the buffer for images of this size.
+   */
+  void attach(uint8_t *buffer, int h, int w)
+  {
+    masks = cv::Mat(h, w, CV_8U, buffer);
+  }
+
+  /**
+   * @brief Take masks computed elsewhere, such as on an OpenCL device
+   *
+   * @param computed CV_8U masks of an image, as `compute()` gives them
+   *
+   * Copies them into the attached buffer when it has their size.
+   */
+  void load(cv::InputArray computed)
+  {
+    computed.copyTo(masks);
+  }
+
+  /**
+   * @brief Recompute the masks around pixels whose color changed
+   *
+   * @param im Image the map was computed from, with the new colors
+   * @param thresh Distance threshold given to `compute()`
+   * @param metric Distance between two pixels
+   * @param connectivity 4 or 8, as for `compute()`
+   * @param pixels Linear indices (x * w + y) of the changed pixels
+   *
+   * Computes the masks of the pixels with `computeAt()`, then mirrors each of
+   * their bits into the opposite bit of the neighbour, as distances are
+   * symmetric.
+   */
+  void update(const cv::Mat &im, double thresh, ColorMetric metric, int connectivity,
+              const std::vector<uint32_t> &pixels);
+
+  /**
+   * @brief Mask of the pixel at linear index idx (x * w + y)
+   */
+  uint8_t bits(int idx) const
+  {
+    return masks.data[idx];
+  }
+
+  /**
+   * @brief The masks as a CV_8U image
+   */
+  const cv::Mat &mat() const
+  {
+    return masks;
+  }
+
+private:
+  cv::Mat masks;
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include "spool.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+#include "batch.hpp"
+#include "run_stats.hpp"
+
+namespace fs = std::filesystem;
+
+// content of the claim file of a completed image
+static const char DONE_MARK[] = "done\n";
+
+/**
+ * @brief Parse a manifest line
+ *
+ * @return False if the line is not a manifest line
+ */
+static bool parseLine(const char *line, size_t &index, bool &ok, int &regions, double &ms)
+{
+  char status[8];
+  if (sscanf(line, "{\"index\": %zu, \"ok\": %5[a-z], \"regions\": %d, \"ms\": %lf", &index, status, &regions,
+             &ms) != 4)
+    return false;
+  ok = strcmp(status, "true") == 0;
+  return true;
+}
+
+/**
+ * @brief Read a whole file into a string from an offset
+ *
+ * @return False on a read error
+ */
+static bool readFrom(int fd, off_t offset, std::string &data)
+{
+  char buffer[65536];
+  for (;;)
+  {
+    ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return false;
+    if (n == 0)
+      return true;
+    data.append(buffer, (size_t)n);
+    offset += n;
+  }
+}
+
+bool SpoolSummary::write(FILE *f) const
+{
+  fprintf(f,
+          "{\"images\": %zu, \"done\": %zu, \"failed\": %zu, \"pending\": %zu, \"regions\": %llu, "
+          "\"segment_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f}\n",
+          images, done, failed, images - done, (unsigned long long)regions, ms,
+          done > failed ? ms / (done - failed) : 0.0, maxMs);
+  return fflush(f) == 0 && !ferror(f);
+}
+
+Spool::~Spool()
+{
+  for (auto &claim : claims)
+    close(claim.second.fd);
+  if (manifest)
+    fclose(manifest);
+  if (manifestRead >= 0)
+    close(manifestRead);
+}
+
+bool Spool::open(const std::string &dir, const std::string &source)
+{
+  this->dir = dir;
+  std::error_code ec;
+  fs::create_directories(fs::path(dir) / "claims", ec);
+  if (ec)
+    return false;
+
+  // the first process writes the queue aside and links it into place, so
+  // that the others only ever see it whole
+  std::string queue = (fs::path(dir) / "queue").string();
+  if (!fs::exists(queue, ec))
+  {
+    std::vector<std::string> sources = listImages(source);
+    if (sources.empty())
+    {
+      images.clear(); // nothing to queue
+      return true;
+    }
+    std::string aside = queue + "." + std::to_string(getpid()) + ".tmp";
+    {
+      std::ofstream out(aside);
+      std::unordered_set<std::string> seen;
+      for (const std::string &path : sources)
+      {
+        if (seen.insert(path).second)
+          out << path << '\n';
+      }
+      if (!out.flush())
+        return false;
+    }
+    bool linked = link(aside.c_str(), queue.c_str()) == 0 || errno == EEXIST;
+    unlink(aside.c_str());
+    if (!linked)
+      return false;
+  }
+  std::ifstream in(queue);
+  if (!in)
+    return false;
+  images.clear();
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (!line.empty())
+      images.push_back(line);
+  }
+  completed.assign(images.size(), false);
+  cursor = 0;
+  rescan = false;
+
+  std::string path = (fs::path(dir) / "manifest").string();
+  manifest = fopen(path.c_str(), "a");
+  manifestRead = manifest ? ::open(path.c_str(), O_RDONLY) : -1;
+  readOffset = 0;
+  return manifestRead >= 0;
+}
+
+void Spool::readManifest()
+{
+  std::string data;
+  if (!readFrom(manifestRead, readOffset, data))
+    return;
+  // a line without its newline is still being written: read it next time
+  size_t end = data.rfind('\n');
+  if (end == std::string::npos)
+    return;
+  data.resize(end + 1);
+  readOffset += (off_t)data.size();
+  for (size_t start = 0; start < data.size();)
+  {
+    size_t stop = data.find('\n', start);
+    data[stop] = '\0';
+    size_t index;
+    bool ok;
+    int regions;
+    double ms;
+    if (parseLine(data.c_str() + start, index, ok, regions, ms) && index < completed.size())
+      completed[index] = true;
+    start = stop + 1;
+  }
+}
+
+bool Spool::claim(std::string &path)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  readManifest();
+  for (;;)
+  {
+    if (cursor == images.size())
+    {
+      // images claimed meanwhile by processes that died are free again
+      if (rescan)
+        return false;
+      rescan = true;
+      cursor = 0;
+      continue;
+    }
+    size_t index = cursor++;
+    if (completed[index] || claims.count(images[index]))
+      continue;
+    std::string file = (fs::path(dir) / "claims" / std::to_string(index)).string();
+    int fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      continue;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+      close(fd); // claimed by a live process
+      continue;
+    }
+    // the claim may have been completed since the manifest was read
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size > 0)
+    {
+      completed[index] = true;
+      close(fd);
+      continue;
+    }
+    claims[images[index]] = Claim{index, fd, 0, 0};
+    path = images[index];
+    return true;
+  }
+}
+
+void Spool::record(const std::string &path, int regions, double ms)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto claim = claims.find(path);
+  if (claim != claims.end())
+  {
+    claim->second.regions = regions;
+    claim->second.ms = ms;
+  }
+}
+
+bool Spool::complete(const std::string &path, bool ok)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = claims.find(path);
+  if (found == claims.end())
+    return false;
+  Claim claim = found->second;
+  claims.erase(found);
+  completed[claim.index] = true;
+
+  // one write per line, under the lock of the manifest, so that lines of
+  // processes on other machines do not interleave
+  bool written = flock(fileno(manifest), LOCK_EX) == 0;
+  fprintf(manifest, "{\"index\": %zu, \"ok\": %s, \"regions\": %d, \"ms\": %.3f, \"image\": ", claim.index,
+          ok ? "true" : "false", claim.regions, claim.ms);
+  writeJsonString(manifest, path.c_str());
+  fputs("}\n", manifest);
+  written = fflush(manifest) == 0 && !ferror(manifest) && written;
+  flock(fileno(manifest), LOCK_UN);
+
+  // marking the claim file after the manifest line, a process dying in
+  // between leaves the image to be done again rather than lost
+  written = ::write(claim.fd, DONE_MARK, sizeof(DONE_MARK) - 1) == (ssize_t)(sizeof(DONE_MARK) - 1) && written;
+  close(claim.fd);
+  return written;
+}
+
+SpoolSummary Spool::summary()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  SpoolSummary summary;
+  summary.images = images.size();
+  std::string data;
+  if (!readFrom(manifestRead, 0, data))
+    return summary;
+
+  // the last line of every image
+  struct Result
+  {
+    bool seen = false, ok = false;
+    int regions = 0;
+    double ms = 0;
+  };
+  std::vector<Result> results(images.size());
+  for (size_t start = 0; start < data.size();)
+  {
+    size_t stop = data.find('\n', start);
+    if (stop == std::string::npos)
+      break; // still being written
+    data[stop] = '\0';
+    Result result;
+    size_t index;
+    if (parseLine(data.c_str() + start, index, result.ok, result.regions, result.ms) && index < results.size())
+    {
+      result.seen = true;
+      results[index] = result;
+    }
+    start = stop + 1;
+  }
+  for (const Result &result : results)
+  {
+    if (!result.seen)
+      continue;
+    summary.done++;
+    if (!result.ok)
+    {
+      summary.failed++;
+      continue;
+    }
+    summary.regions += (uint64_t)std::max(result.regions, 0);
+    summary.ms += result.ms;
+    summary.maxMs = std::max(summary.maxMs, result.ms);
+  }
+  return summary;
+}
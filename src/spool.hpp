@@ -0,0 +1,157 @@
+#ifndef SPOOL_HPP
+#define SPOOL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Results of a spool, aggregated over all the processes that worked on it
+ */
+struct SpoolSummary
+{
+  size_t images = 0;    // images in the queue
+  size_t done = 0;      // images completed, successfully or not
+  size_t failed = 0;    // completed images that could not be decoded, segmented or written
+  uint64_t regions = 0; // regions of the successful images
+  double ms = 0;        // segmentation time of the successful images
+  double maxMs = 0;     // longest segmentation of an image
+
+  /**
+   * @brief Write the summary as one JSON object on a line
+   *
+   * @return False on a write error
+   */
+  bool write(FILE *f) const;
+};
+
+/**
+ * @brief Queue of images shared by processes through a spool directory
+ *
+ * The spool holds the list of images, `queue`, written once by the first
+ * process to open it, a lock file per image in `claims/`, and the
+ * completion manifest, `manifest`, which gets one JSON line per completed
+ * image: its index in the queue, whether it succeeded, its number of
+ * regions, its segmentation time and its path.
+ *
+ * A process claims an image by taking an exclusive `flock()` on its lock
+ * file, and holds it until the image is completed, when it writes its line
+ * to the manifest and marks the lock file as done. The kernel releases the
+ * locks of a process that dies, so the images it was working on go to the
+ * next process that looks for work; a process finding no free image looks
+ * once more through the whole queue for such images before it stops.
+ * Running the same command again on the spool resumes it: completed images
+ * are skipped, and the queue is kept even if the source has changed since
+ * (remove the spool to start over).
+ *
+ * Any number of processes may share a spool, on one machine or on several
+ * machines mounting it over NFS, whose clients implement `flock()` with
+ * locks of the server. Claims, results and completions of one Spool may be
+ * made from several threads.
+ */
+class Spool
+{
+public:
+  Spool() {}
+
+  /**
+   * @brief Release the claims that were not completed, for other processes
+   */
+  ~Spool();
+
+  Spool(const Spool &) = delete;
+  Spool &operator=(const Spool &) = delete;
+
+  /**
+   * @brief Open a spool, creating it if needed
+   *
+   * @param dir The spool directory
+   * @param source Images of a new spool, see `listImages()`; ignored if the
+   * spool already has a queue
+   *
+   * @return False if the spool cannot be created or read. A new spool whose
+   * source has no image is not created, and has a `size()` of 0.
+   *
+   * Open a Spool of its own in every process: claims are locks of the open
+   * files, which a process shares with its children.
+   */
+  bool open(const std::string &dir, const std::string &source);
+
+  /**
+   * @brief Number of images in the queue
+   */
+  size_t size() const
+  {
+    return images.size();
+  }
+
+  /**
+   * @brief Claim the next image that is neither completed nor claimed
+   *
+   * @param path Receives the path of the image
+   *
+   * @return False if there is none left
+   */
+  bool claim(std::string &path);
+
+  /**
+   * @brief Record the segmentation of a claimed image, for its manifest line
+   *
+   * @param path The path given by `claim()`
+   * @param regions Its number of regions
+   * @param ms Its segmentation time in milliseconds
+   */
+  void record(const std::string &path, int regions, double ms);
+
+  /**
+   * @brief Complete a claimed image and release its claim
+   *
+   * @param path The path given by `claim()`
+   * @param ok Whether it succeeded; failed images are completed all the
+   * same, and not tried again
+   *
+   * @return False if the manifest cannot be written
+   */
+  bool complete(const std::string &path, bool ok);
+
+  /**
+   * @brief Summary of the manifest, over all the processes
+   *
+   * An image completed twice, by a process that died between writing its
+   * line and marking its claim, is counted once, with its last line.
+   */
+  SpoolSummary summary();
+
+private:
+  // an image claimed by this process
+  struct Claim
+  {
+    size_t index; // in the queue
+    int fd;       // its locked claim file
+    int regions;
+    double ms;
+  };
+
+  /**
+   * @brief Mark the images completed by the manifest lines added since the last call
+   */
+  void readManifest();
+
+  std::string dir;
+  std::vector<std::string> images; // the queue
+  std::vector<bool> completed;     // images this process knows to be completed
+  std::unordered_map<std::string, Claim> claims;
+  size_t cursor = 0;    // next image to try to claim
+  bool rescan = false;  // whether the cursor went through the queue once already
+  FILE *manifest = NULL;
+  int manifestRead = -1; // descriptor reading the manifest
+  off_t readOffset = 0;  // end of the complete manifest lines read so far
+  std::mutex lock;
+};
+
+#endif
@@ -0,0 +1,419 @@
+#include "strip_stream.hpp"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "color_distance.hpp"
+#include "similarity_map.hpp"
+#include "union_find.hpp"
+
+/**
+ * @brief Read a number of a PPM header, skipping whitespace and comments
+ *
+ * @return False if there is no number at p
+ */
+static bool headerNumber(const uint8_t *&p, const uint8_t *end, long &value)
+{
+  while (p < end && (isspace(*p) || *p == '#'))
+  {
+    if (*p == '#')
+    {
+      while (p < end && *p != '\n')
+        p++;
+    }
+    else
+      p++;
+  }
+  if (p == end || !isdigit(*p))
+    return false;
+  value = 0;
+  while (p < end && isdigit(*p) && value <= INT32_MAX)
+    value = value * 10 + (*p++ - '0');
+  return value <= INT32_MAX;
+}
+
+bool MappedImage::open(const std::string &path)
+{
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 2)
+  {
+    ::close(fd);
+    return false;
+  }
+  void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping keeps the file open
+  if (p == MAP_FAILED)
+    return false;
+  map = (uint8_t *)p;
+  mapBytes = st.st_size;
+
+  const uint8_t *cur = map + 2, *end = map + mapBytes;
+  long width, height, maxval;
+  if (map[0] != 'P' || map[1] != '6' || !headerNumber(cur, end, width) || !headerNumber(cur, end, height) ||
+      !headerNumber(cur, end, maxval) || maxval != 255 || cur == end || !isspace(*cur))
+  {
+    close();
+    return false;
+  }
+  pixels = cur + 1; // a single whitespace ends the header
+  if ((size_t)(end - pixels) / 3 / (width ? width : 1) < (size_t)height)
+  {
+    close();
+    return false;
+  }
+  h = (int)height;
+  w = (int)width;
+  return true;
+}
+
+void MappedImage::close()
+{
+  if (map)
+    munmap(map, mapBytes);
+  map = NULL;
+  mapBytes = 0;
+  pixels = NULL;
+  h = w = 0;
+}
+
+void MappedImage::advise(int r0, int r1, int advice) const
+{
+  const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)(pixels + (size_t)r0 * w * 3);
+  uintptr_t stop = (uintptr_t)(pixels + (size_t)r1 * w * 3);
+  if (advice == MADV_DONTNEED)
+  {
+    start = (start + page - 1) & ~(page - 1); // only pages holding these rows alone
+    stop &= ~(page - 1);
+  }
+  else
+  {
+    start &= ~(page - 1);
+    stop = std::min((stop + page - 1) & ~(page - 1), (uintptr_t)(map + mapBytes + page - 1) & ~(page - 1));
+  }
+  if (start < stop)
+    madvise((void *)start, stop - start, advice);
+}
+
+void MappedImage::prefetch(int r0, int r1) const
+{
+  advise(r0, r1, MADV_WILLNEED);
+}
+
+void MappedImage::release(int r0, int r1) const
+{
+  advise(r0, r1, MADV_DONTNEED);
+}
+
+// what becomes of a provisional label of a strip, in the map file
+struct StripLabel
+{
+  uint32_t root;  // root of its set in the strip; after the backward pass, first root of the strip in its region
+  uint32_t carry; // id of its set in the next strip, 0 if the set ends in this strip
+  uint32_t kept;  // whether its region has at least min_region pixels, once known
+};
+
+// number of labels of the table of a strip, written before and after it
+struct StripHeader
+{
+  uint32_t labels;  // provisional labels of the strip
+  uint32_t carried; // of which the first ones are the sets carried from the previous strip
+};
+
+/**
+ * @brief Write a whole buffer at an offset of a file
+ */
+static bool writeAt(int fd, const void *data, size_t bytes, off_t offset)
+{
+  const char *p = (const char *)data;
+  while (bytes > 0)
+  {
+    ssize_t n = pwrite(fd, p, bytes, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    bytes -= (size_t)n;
+    offset += n;
+  }
+  return true;
+}
+
+/**
+ * @brief Read a whole buffer from an offset of a file
+ */
+static bool readAt(int fd, void *data, size_t bytes, off_t offset)
+{
+  char *p = (char *)data;
+  while (bytes > 0)
+  {
+    ssize_t n = pread(fd, p, bytes, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    bytes -= (size_t)n;
+    offset += n;
+  }
+  return true;
+}
+
+/**
+ * @brief Size in the map file of the table of a strip, with its header and trailer
+ */
+static off_t tableBytes(uint32_t labels)
+{
+  return (off_t)(2 * sizeof(StripHeader) + (size_t)labels * sizeof(StripLabel));
+}
+
+/**
+ * @brief First pass: label the strips with provisional labels, and write what becomes of them
+ *
+ * @return The end of the map file, or -1 on a write error
+ *
+ * Every strip has labels of its own: the sets still present in the last row
+ * of the previous strip are carried as labels 1..carried, in the order of
+ * their roots, and the strip adds its new labels after them. At the end of
+ * a strip, the table of its labels gives the root of every label, the
+ * label in the next strip of the sets still present in its last row, and
+ * whether the other sets, which end there, are kept.
+ */
+static off_t labelStrips(const MappedImage &im, int thresh2, int min_region, int strip_rows,
+                         LabelFileWriter &provisional, int mapFd)
+{
+  const int h = im.rows(), w = im.cols();
+  UnionFind sets;
+  std::vector<uint64_t> count;                // pixels of every label of the strip
+  std::vector<uint64_t> carriedCount(1, 0);   // of the sets carried into the next strip
+  std::vector<uint32_t> prev(w), cur(w), next;
+  std::vector<StripLabel> table;
+  SimilarityMap similar;
+  uint32_t carried = 0;
+  off_t end = 0;
+
+  for (int r0 = 0; r0 < h; r0 += strip_rows)
+  {
+    const int r1 = std::min(h, r0 + strip_rows);
+    const int top = r0 > 0 ? r0 - 1 : 0; // last row of the previous strip, for the bits of the row above
+    if (r1 < h)
+      im.prefetch(r1, std::min(h, r1 + strip_rows));
+    similar.compute(im.view(top, r1), thresh2);
+    sets.reset(carried);
+    count.assign(carriedCount.begin(), carriedCount.begin() + carried + 1);
+
+    for (int x = r0; x < r1; x++)
+    {
+      const uint8_t *bits = similar.mat().ptr<uint8_t>(x - top);
+      for (int y = 0; y < w; y++)
+      {
+        unsigned b = bits[y] & 0x0Fu; // slots 0 to 3: row above and left
+        uint32_t label = 0;
+        // edges are not transitive, so every similar scanned neighbour has
+        // to be united with the pixel, not only the first one
+        for (int slot = 0; b; slot++, b >>= 1)
+        {
+          if (!(b & 1u))
+            continue;
+          uint32_t l = slot == 3 ? cur[y - 1] : prev[y + slot - 1];
+          if (label == 0)
+            label = l;
+          else
+            sets.unite(label, l);
+        }
+        if (label == 0)
+        {
+          label = sets.add();
+          count.push_back(0);
+        }
+        cur[y] = label;
+        count[label]++;
+      }
+      if (!provisional.writeRow(cur.data()))
+        return -1;
+      prev.swap(cur);
+    }
+    im.release(top, r1 - 1);
+
+    // the root of a set is its smallest label, so it comes first; the sets
+    // of the last row go on in the next strip, numbered in the order of
+    // their roots so that the roots there still come first
+    const uint32_t n = sets.size();
+    for (uint32_t id = 1; id <= n; id++)
+    {
+      uint32_t root = sets.find(id);
+      if (root != id)
+        count[root] += count[id];
+    }
+    next.assign(n + 1, 0);
+    if (r1 < h)
+    {
+      for (int y = 0; y < w; y++)
+        next[sets.find(prev[y])] = 1;
+    }
+    uint32_t going = 0;
+    for (uint32_t id = 1; id <= n; id++)
+    {
+      if (next[id])
+        next[id] = ++going;
+    }
+    carriedCount.assign(going + 1, 0);
+    table.resize(n);
+    for (uint32_t id = 1; id <= n; id++)
+    {
+      uint32_t root = sets.find(id);
+      table[id - 1] = StripLabel{root, next[root], count[root] >= (uint64_t)std::max(min_region, 0)};
+      if (root == id && next[id])
+        carriedCount[next[id]] = count[id];
+    }
+    for (int y = 0; y < w; y++)
+      prev[y] = next[sets.find(prev[y])];
+
+    StripHeader header{n, carried};
+    if (!writeAt(mapFd, &header, sizeof(header), end) ||
+        !writeAt(mapFd, table.data(), n * sizeof(StripLabel), end + (off_t)sizeof(header)) ||
+        !writeAt(mapFd, &header, sizeof(header), end + tableBytes(n) - (off_t)sizeof(header)))
+      return -1;
+    end += tableBytes(n);
+    carried = going;
+  }
+  return end;
+}
+
+/**
+ * @brief Backward pass: resolve the roots of every strip to their regions
+ *
+ * @return False on a read or write error
+ *
+ * Sets of a strip merge in the strips after it, so the strips are resolved
+ * from the last one up, each from the regions of the sets it carries into
+ * the next one: the root of every label becomes the first root of the strip
+ * in its region, and `kept` that of its region.
+ */
+static bool resolveStrips(int mapFd, off_t end)
+{
+  std::vector<StripLabel> table;
+  std::vector<StripLabel> carriedOn(1); // resolved labels of the sets carried into the strip below
+  std::vector<uint32_t> first;          // first root of the strip in every region of the strip below
+  while (end > 0)
+  {
+    StripHeader header;
+    if (!readAt(mapFd, &header, sizeof(header), end - (off_t)sizeof(header)))
+      return false;
+    const off_t start = end - tableBytes(header.labels);
+    table.resize(header.labels);
+    if (!readAt(mapFd, table.data(), table.size() * sizeof(StripLabel), start + (off_t)sizeof(header)))
+      return false;
+
+    // a root comes before its other labels, so they find it resolved
+    first.assign(carriedOn.size(), 0);
+    for (uint32_t id = 1; id <= header.labels; id++)
+    {
+      StripLabel &label = table[id - 1];
+      if (label.root != id)
+      {
+        const StripLabel &root = table[label.root - 1];
+        label.root = root.root;
+        label.kept = root.kept;
+      }
+      else if (label.carry != 0)
+      {
+        const StripLabel &below = carriedOn[label.carry];
+        if (first[below.root] == 0)
+          first[below.root] = id;
+        label.root = first[below.root];
+        label.kept = below.kept;
+      }
+    }
+    if (!writeAt(mapFd, table.data(), table.size() * sizeof(StripLabel), start + (off_t)sizeof(header)))
+      return false;
+    carriedOn.assign(table.begin(), table.begin() + header.carried);
+    carriedOn.insert(carriedOn.begin(), StripLabel{});
+    end = start;
+  }
+  return true;
+}
+
+int streamRegionGrow(const MappedImage &im, float th, int min_region, int strip_rows, const std::string &output,
+                     LabelFormat format)
+{
+  const int h = im.rows(), w = im.cols();
+  const std::string partial = output + ".part.rle", mapPath = output + ".part.map";
+  strip_rows = std::max(strip_rows, 1);
+
+  int mapFd = ::open(mapPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (mapFd < 0)
+    return -1;
+  bool ok;
+  {
+    LabelFileWriter provisional;
+    ok = provisional.open(partial, h, w, LABELS_RLE);
+    off_t end = ok ? labelStrips(im, squaredThreshold(th), min_region, strip_rows, provisional, mapFd) : -1;
+    ok = provisional.close() && end >= 0 && resolveStrips(mapFd, end);
+  }
+
+  // second pass: final labels, numbered by the raster order of the first
+  // pixel of their region, which is the first pixel of its first root
+  int regions = 0;
+  LabelFileReader reader;
+  LabelFileWriter writer;
+  ok = ok && reader.open(partial) && writer.open(output, h, w, format);
+  std::vector<StripLabel> table;
+  std::vector<uint32_t> carriedLabel(1, 0), nextLabel, number, row(w);
+  off_t offset = 0;
+  for (int r0 = 0; ok && r0 < h; r0 += strip_rows)
+  {
+    StripHeader header;
+    ok = readAt(mapFd, &header, sizeof(header), offset);
+    table.resize(ok ? header.labels : 0);
+    ok = ok && readAt(mapFd, table.data(), table.size() * sizeof(StripLabel), offset + (off_t)sizeof(header));
+    offset += tableBytes(header.labels);
+    number.assign(table.size() + 1, 0);
+    auto finalLabel = [&](uint32_t root) -> uint32_t &
+    {
+      return root <= header.carried ? carriedLabel[root] : number[root];
+    };
+
+    for (int x = r0; ok && x < std::min(h, r0 + strip_rows); x++)
+    {
+      ok = reader.readRow(row.data());
+      for (int y = 0; ok && y < w; y++)
+      {
+        const StripLabel &label = table[row[y] - 1];
+        uint32_t &final = finalLabel(label.root);
+        if (final == 0)
+          final = label.kept ? ++regions : LABEL_REJECTED;
+        row[y] = final;
+      }
+      ok = ok && writer.writeRow(row.data());
+    }
+
+    nextLabel.assign(1, 0);
+    for (const StripLabel &label : table)
+    {
+      if (label.carry == 0)
+        continue;
+      if (label.carry >= nextLabel.size())
+        nextLabel.resize(label.carry + 1, 0);
+      nextLabel[label.carry] = finalLabel(label.root);
+    }
+    carriedLabel.swap(nextLabel);
+  }
+  ok = writer.close() && ok;
+  reader.close();
+  ::close(mapFd);
+  remove(partial.c_str());
+  remove(mapPath.c_str());
+  return ok ? regions : -1;
+}
@@ -0,0 +1,132 @@
+#ifndef STRIP_STREAM_HPP
+#define STRIP_STREAM_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "label_io.hpp"
+
+/**
+ * @brief Memory-mapped binary PPM (P6) image, read strip by strip
+ *
+ * The pixels are used in place from a read-only mapping of the file, so an
+ * image larger than the memory can be processed: only the rows being read
+ * are resident, and `release()` gives the pages of the rows already
+ * processed back to the kernel. The pixels are in RGB order, as stored in
+ * the file.
+ */
+class MappedImage
+{
+public:
+  MappedImage() {}
+
+  ~MappedImage()
+  {
+    close();
+  }
+
+  MappedImage(const MappedImage &) = delete;
+  MappedImage &operator=(const MappedImage &) = delete;
+
+  /**
+   * @brief Map an image file
+   *
+   * @param path Path of a binary PPM file with a maximum value of 255
+   *
+   * @return False if the file cannot be mapped or is not such a PPM file
+   */
+  bool open(const std::string &path);
+
+  /**
+   * @brief Unmap the file
+   */
+  void close();
+
+  /**
+   * @brief Height of the image
+   */
+  int rows() const
+  {
+    return h;
+  }
+
+  /**
+   * @brief Width of the image
+   */
+  int cols() const
+  {
+    return w;
+  }
+
+  /**
+   * @brief CV_8UC3 view of the rows [r0, r1), without any copy
+   */
+  cv::Mat view(int r0, int r1) const
+  {
+    return cv::Mat(r1 - r0, w, CV_8UC3, (void *)(pixels + (size_t)r0 * w * 3));
+  }
+
+  /**
+   * @brief Ask the kernel to read the rows [r0, r1) ahead
+   */
+  void prefetch(int r0, int r1) const;
+
+  /**
+   * @brief Drop the pages holding only rows in [r0, r1) from memory
+   *
+   * The rows can still be read, from the file again.
+   */
+  void release(int r0, int r1) const;
+
+private:
+  /**
+   * @brief Apply madvise to the whole pages of the rows [r0, r1)
+   */
+  void advise(int r0, int r1, int advice) const;
+
+  uint8_t *map = NULL;          // the whole file
+  size_t mapBytes = 0;
+  const uint8_t *pixels = NULL; // first pixel, after the header
+  int h = 0, w = 0;
+};
+
+/**
+ * @brief Label the regions of an image strip by strip, writing the labels to a file
+ *
+ * @param im The image
+ * @param th Threshold value for region growing
+ * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+ * @param strip_rows Number of rows of a strip
+ * @param output Path of the label file
+ * @param format `LABELS_RAW` or `LABELS_RLE`
+ *
+ * @return The number of regions, or -1 if a file cannot be written
+ *
+ * The regions and their labels are the same as those of `labelRegionGrow`
+ * (see `exportLabels()`), from the same 8-connected similarity graph, but
+ * neither the image nor its labels are ever held in full. The first pass
+ * computes the similarity masks of one strip at a time, plus the last row of
+ * the previous strip, and labels its rows with a scanline union-find (see
+ * `scanLabelRows`): a pixel takes the provisional label of its similar
+ * neighbours on the left and in the row above, or a new one. Every finished
+ * row is written as runs of provisional labels to a temporary file next to
+ * the output, and the pages of the strip are released. Provisional labels
+ * are those of their strip: at the end of a strip, the sets present in its
+ * last row are carried into the next strip as its first labels, and the
+ * other sets, which end there, are retired with their size to a second
+ * temporary file, the map, with the root of every label of the strip. A
+ * backward pass over the map, from the last strip up, resolves the sets that
+ * merge in later strips to their regions, and a second pass rewrites the
+ * labels into the output one row at a time, numbering the regions by the
+ * raster order of their first pixel and rejecting the regions smaller than
+ * `min_region`.
+ *
+ * Memory is O(strip_rows * w) for the pixels, masks and labels of a strip,
+ * whatever the number of regions, instead of O(h * w); the map takes 12 bytes
+ * per provisional label on disk.
+ */
+int streamRegionGrow(const MappedImage &im, float th, int min_region, int strip_rows, const std::string &output,
+                     LabelFormat format);
+
+#endif
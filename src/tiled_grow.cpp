@@ -0,0 +1,144 @@
+#include "tiled_grow.hpp"
+#include <algorithm>
+#include <vector>
+#include "frontier.hpp"
+#include "union_find.hpp"
+
+/**
+ * @brief Flood fill the regions of the rows [r0, r1) with tile-local labels
+ *
+ * @param sizes Receives the number of pixels of each local region, in label order
+ * @param scratch Room for the (r1 - r0) * w pixels of the tile, or NULL
+ *
+ * Local labels start at 1 and follow the raster order of the first pixel of
+ * each region. Neighbours outside the tile are never visited.
+ */
+static void floodTile(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels,
+                      int r0, int r1, int w, std::vector<size_t> &sizes, uint32_t *scratch)
+{
+  Frontier frontier;
+  if (scratch)
+    frontier.attach(scratch, (size_t)(r1 - r0) * w);
+  else
+    frontier.reserve((size_t)(r1 - r0) * w);
+  uint32_t local = 0;
+  for (int x0 = r0; x0 < r1; x0++)
+  {
+    for (int y0 = 0; y0 < w; y0++)
+    {
+      int idx0 = x0 * w + y0;
+      if (labels.get(idx0) != 0)
+        continue;
+      local++;
+      labels.set(idx0, local);
+      frontier.push(idx0);
+      size_t count = 1;
+
+      while (!frontier.empty())
+      {
+        int idx = frontier.pop();
+        int x = idx / w, y = idx % w;
+        unsigned bits = similar.bits(idx);
+        if (x == r0)
+          bits &= ~0x07u; // slots 0, 1, 2: row above
+        if (x == r1 - 1)
+          bits &= ~0xE0u; // slots 5, 6, 7: row below
+        nbh.forEachIn(x, y, bits, [&](int, int, int nidx)
+        {
+          if (labels.get(nidx) == 0)
+          {
+            labels.set(nidx, local);
+            frontier.push(nidx);
+            count++;
+          }
+          return true;
+        });
+      }
+      sizes.push_back(count);
+    }
+  }
+}
+
+int growTiled(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels,
+              int min_region, int tiles, LabelEngine engine, uint32_t *scratch)
+{
+  const int h = similar.mat().rows, w = similar.mat().cols;
+  if (h == 0 || w == 0)
+    return 0;
+  tiles = std::max(1, std::min(tiles, h));
+
+  std::vector<int> first(tiles + 1); // first row of each tile
+  for (int t = 0; t <= tiles; t++)
+    first[t] = (int)((long long)t * h / tiles);
+
+  std::vector<std::vector<size_t>> sizes(tiles);
+  cv::parallel_for_(cv::Range(0, tiles), [&](const cv::Range &range)
+  {
+    for (int t = range.start; t < range.end; t++)
+    {
+      if (engine == ENGINE_SCAN)
+        scanLabelRows(similar, nbh, labels, first[t], first[t + 1], sizes[t]);
+      else
+        floodTile(similar, nbh, labels, first[t], first[t + 1], w, sizes[t],
+                  scratch ? scratch + (size_t)first[t] * w : NULL);
+    }
+  });
+
+  // global id of a local region: offset of its tile + local label
+  std::vector<uint32_t> offset(tiles + 1, 0);
+  for (int t = 0; t < tiles; t++)
+    offset[t + 1] = offset[t] + (uint32_t)sizes[t].size();
+  const uint32_t n = offset[tiles];
+
+  UnionFind sets;
+  sets.resize(n);
+  for (int t = 1; t < tiles; t++)
+  {
+    int x = first[t] - 1; // last row of the tile above the seam
+    for (int y = 0; y < w; y++)
+    {
+      uint32_t id = offset[t - 1] + labels.get(x, y);
+      nbh.forEachIn(x, y, similar.bits(x * w + y) & 0xE0u, [&](int, int, int nidx)
+      {
+        sets.unite(id, offset[t] + labels.get(nidx));
+        return true;
+      });
+    }
+  }
+
+  // tile-local labels, and thus ids, follow the raster order of the first
+  // pixel of each region part, so numbering roots by increasing id reproduces
+  // the numbering of the serial scan
+  std::vector<size_t> area(n + 1, 0);
+  for (int t = 0; t < tiles; t++)
+  {
+    for (size_t l = 0; l < sizes[t].size(); l++)
+      area[sets.find(offset[t] + (uint32_t)l + 1)] += sizes[t][l];
+  }
+  std::vector<uint32_t> final(n + 1, 0);
+  int regions = 0;
+  bool identity = true;
+  for (uint32_t id = 1; id <= n; id++)
+  {
+    uint32_t root = sets.find(id);
+    if (root != id)
+      final[id] = final[root];
+    else if (area[id] >= (size_t)min_region)
+      final[id] = ++regions;
+    else
+      final[id] = labels.maxLabel();
+    identity = identity && final[id] == id;
+  }
+  if (identity) // nothing to renumber
+    return regions;
+
+  cv::parallel_for_(cv::Range(0, tiles), [&](const cv::Range &range)
+  {
+    for (int t = range.start; t < range.end; t++)
+    {
+      for (int idx = first[t] * w; idx < first[t + 1] * w; idx++)
+        labels.set(idx, final[offset[t] + labels.get(idx)]);
+    }
+  });
+  return regions;
+}
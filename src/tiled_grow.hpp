@@ -0,0 +1,34 @@
+#ifndef TILED_GROW_HPP
+#define TILED_GROW_HPP
+
+#include "label_map.hpp"
+#include "neighbourhood.hpp"
+#include "scan_label.hpp"
+#include "similarity_map.hpp"
+
+/**
+ * @brief Label the regions of an image in parallel horizontal tiles
+ *
+ * @param similar Similarity map of the image for the threshold
+ * @param nbh Neighbourhood of the image
+ * @param labels Label map of the image, all zeros, sized for h * w regions
+ * @param min_region Minimum number of pixels of a region, 0 to keep all regions
+ * @param tiles Number of horizontal tiles to grow concurrently
+ * @param engine Algorithm labeling each tile
+ * @param scratch Room for h * w pixel indices shared by the frontiers of the
+ * tiles, or NULL to allocate them
+ *
+ * @return The number of regions
+ *
+ * The image is split into bands of rows which are grown independently on the
+ * OpenCV thread pool. Regions crossing a seam between two bands are then
+ * merged with a union-find over the per-band regions, and every region is
+ * numbered by the raster order of its first pixel. The result is identical
+ * to the serial scan of `ApplyRegionGrow`, including the rejection of regions
+ * smaller than `min_region`, whose pixels are labeled `labels.maxLabel()`,
+ * whatever the engine and the number of tiles.
+ */
+int growTiled(const SimilarityMap &similar, const Neighbourhood &nbh, LabelMap &labels,
+              int min_region, int tiles, LabelEngine engine, uint32_t *scratch = NULL);
+
+#endif
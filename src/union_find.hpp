@@ -0,0 +1,110 @@
+#ifndef UNION_FIND_HPP
+#define UNION_FIND_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief Disjoint sets of consecutive ids, starting at 1
+ *
+ * The root of a set is always its smallest id. Labelers rely on it: when ids
+ * are created in raster order, the root of a region is the id created at its
+ * first pixel, so numbering roots by increasing id numbers regions by the
+ * raster order of their first pixel.
+ */
+class UnionFind
+{
+public:
+  UnionFind() : parent(1, 0) {}
+
+  /**
+   * @brief Remove every set, keeping the memory
+   */
+  void clear()
+  {
+    parent.assign(1, 0);
+  }
+
+  /**
+   * @brief Create a new singleton set
+   *
+   * @return The id of the new set
+   */
+  uint32_t add()
+  {
+    uint32_t id = (uint32_t)parent.size();
+    parent.push_back(id);
+    return id;
+  }
+
+  /**
+   * @brief Create singleton sets up to id n
+   */
+  void resize(uint32_t n)
+  {
+    while (parent.size() <= n)
+      add();
+  }
+
+  /**
+   * @brief Remove every set, then create singleton sets up to id n
+   */
+  void reset(uint32_t n)
+  {
+    parent.resize((size_t)n + 1);
+    for (uint32_t i = 0; i <= n; i++)
+      parent[i] = i;
+  }
+
+  /**
+   * @brief Number of ids
+   */
+  uint32_t size() const
+  {
+    return (uint32_t)parent.size() - 1;
+  }
+
+  /**
+   * @brief Find the root of the set of an id, halving the path on the way
+   */
+  uint32_t find(uint32_t i)
+  {
+    while (parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  /**
+   * @brief Merge the sets of two ids
+   */
+  void unite(uint32_t a, uint32_t b)
+  {
+    a = find(a);
+    b = find(b);
+    if (a < b)
+      parent[b] = a;
+    else if (b < a)
+      parent[a] = b;
+  }
+
+  /**
+   * @brief Point every id at the root of its set, in one pass
+   *
+   * A parent is always smaller than its children, so the parent of each id
+   * already points at its root when the id is reached. `find()` is then a
+   * single lookup until the next `unite()`.
+   */
+  void flatten()
+  {
+    for (size_t i = 1; i < parent.size(); i++)
+      parent[i] = parent[parent[i]];
+  }
+
+private:
+  std::vector<uint32_t> parent;
+};
+
+#endif
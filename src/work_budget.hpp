@@ -0,0 +1,165 @@
+#ifndef WORK_BUDGET_HPP
+#define WORK_BUDGET_HPP
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+/**
+ * @brief Limits of the growth of one image
+ */
+struct GrowBudget
+{
+  double deadlineMs = 0;  // time allowed from the start of the labeling, 0 for none
+  uint64_t maxPixels = 0; // pixels the growth may visit, 0 for none
+
+  bool unlimited() const
+  {
+    return deadlineMs <= 0 && maxPixels == 0;
+  }
+
+  /**
+   * @brief Set the deadline from a command line option
+   *
+   * @return False, leaving the deadline as it was, unless the text is a
+   * number of milliseconds above 0
+   */
+  bool parseDeadline(const char *text)
+  {
+    char *end;
+    double ms = strtod(text, &end);
+    if (end == text || *end != '\0' || !(ms > 0))
+      return false;
+    deadlineMs = ms;
+    return true;
+  }
+
+  /**
+   * @brief Set the pixel budget from a command line option
+   *
+   * @return False, leaving the budget as it was, unless the text is a whole
+   * number of pixels of at least 1
+   */
+  bool parseMaxPixels(const char *text)
+  {
+    if (!isdigit((unsigned char)*text)) // strtoull takes a sign, and wraps negative numbers around
+      return false;
+    char *end;
+    errno = 0;
+    unsigned long long pixels = strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || pixels < 1)
+      return false;
+    maxPixels = pixels;
+    return true;
+  }
+};
+
+/**
+ * @brief Running budget of a growth, checked every few visited pixels
+ *
+ * The pixels are handed out in chunks of `CHECK_EVERY`: a growing loop calls
+ * `spend()` once per pixel it visits, which only decrements a local countdown,
+ * and the clock is read and the pixel budget taken from only when a chunk is
+ * used up. The pixel budget is thus never exceeded, and the deadline is
+ * overrun by at most the time of one chunk. Once either runs out, every later
+ * `spend()` fails.
+ *
+ * Several threads may share a budget, each with a countdown of its own (see
+ * `spend(uint32_t &)`); the pixels of the chunks they hold when it runs out
+ * are left unused.
+ */
+class WorkBudget
+{
+public:
+  static const uint32_t CHECK_EVERY = 1024; // pixels visited between two checks
+
+  WorkBudget() {}
+
+  WorkBudget(const WorkBudget &) = delete;
+  WorkBudget &operator=(const WorkBudget &) = delete;
+
+  /**
+   * @brief Start spending a budget, from now
+   */
+  void start(const GrowBudget &budget)
+  {
+    timed = budget.deadlineMs > 0;
+    if (timed)
+      deadline = std::chrono::steady_clock::now() +
+                 std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double, std::milli>(budget.deadlineMs));
+    left.store(budget.maxPixels > 0 ? budget.maxPixels : UINT64_MAX, std::memory_order_relaxed);
+    out.store(false, std::memory_order_relaxed);
+    countdown = 0;
+  }
+
+  /**
+   * @brief Count a visited pixel, for a single growing loop
+   *
+   * @return False if the budget ran out, in which case the pixel must not be visited
+   */
+  bool spend()
+  {
+    return spend(countdown);
+  }
+
+  /**
+   * @brief Count a visited pixel against a countdown of the caller
+   *
+   * @param countdown Pixels left in the chunk of the calling thread, 0 to start
+   *
+   * @return False if the budget ran out
+   */
+  bool spend(uint32_t &countdown)
+  {
+    if (countdown == 0 && !refill(countdown))
+      return false;
+    countdown--;
+    return true;
+  }
+
+  /**
+   * @brief Whether a `spend()` failed since `start()`
+   */
+  bool exhausted() const
+  {
+    return out.load(std::memory_order_relaxed);
+  }
+
+private:
+  /**
+   * @brief Take the next chunk of pixels, unless the deadline has passed
+   */
+  bool refill(uint32_t &countdown)
+  {
+    if (exhausted() || (timed && std::chrono::steady_clock::now() >= deadline))
+    {
+      out.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    uint64_t cur = left.load(std::memory_order_relaxed), chunk;
+    do
+    {
+      chunk = std::min<uint64_t>(cur, CHECK_EVERY);
+      if (chunk == 0)
+      {
+        out.store(true, std::memory_order_relaxed);
+        return false;
+      }
+    } while (!left.compare_exchange_weak(cur, cur - chunk, std::memory_order_relaxed));
+    countdown = (uint32_t)chunk;
+    return true;
+  }
+
+  std::atomic<uint64_t> left{UINT64_MAX}; // pixels not handed out yet
+  std::atomic<bool> out{false};           // a spend() failed
+  bool timed = false;
+  std::chrono::steady_clock::time_point deadline;
+  uint32_t countdown = 0; // of spend()
+};
+
+#endif